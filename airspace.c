@@ -0,0 +1,335 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include "airspace.h"
+
+// Class B, C and D airspace for the FAR 91.117 speed limits, loaded once
+// from a text file, # starts a comment:
+//
+//   airspace NAME B|C|D FLOOR CEILING circle LAT LON RADIUS nm|mi
+//   airspace NAME B|C|D FLOOR CEILING
+//   LAT LON
+//   ...
+//   end
+//
+// FLOOR and CEILING are feet MSL. A polygon lists its vertices one per
+// line, circles are turned into polygons as they load. Class C and D
+// entries should be the areas 91.117(b) holds to 200 kt, within 4 nm of
+// the airport up to 2,500 ft above it, rather than the charted airspace.
+// Class B entries are the charted sectors: inside them the 250 kt limit
+// still applies, underneath a sector with its floor above the ground it
+// is 200 kt.
+//
+// Each volume keeps the altitude band its 200 kt limit covers. A lat/lon
+// grid over all of them lists in each cell the volumes whose bounding box
+// touches the cell, so a lookup is one cell, an altitude test for each of
+// its volumes and a point in polygon test for the few left.
+
+#define AIRSPACE_LIMIT_CAS 200 // 91.117(b) and (c), kt indicated
+#define AIRSPACE_NAME_LEN 24
+#define AIRSPACE_CELL 0.02 // degrees, about a mile
+#define AIRSPACE_CELLS_MAX (1 << 20)
+#define AIRSPACE_CIRCLE_VERTICES 32
+
+typedef struct airspace_volume_t {
+	char name[AIRSPACE_NAME_LEN];
+	int32_t low, high; // ft MSL, inclusive, the band AIRSPACE_LIMIT_CAS covers
+	float min_lat, min_lon, max_lat, max_lon;
+	int first_vertex;
+	int vertex_count;
+} airspace_volume_t;
+
+typedef struct airspace_vertex_t {
+	float latitude;
+	float longitude;
+} airspace_vertex_t;
+
+static airspace_volume_t *Volumes;
+static int VolumeCount, VolumeAlloc;
+static airspace_vertex_t *Vertices;
+static int VertexCount, VertexAlloc;
+
+static double GridLat0, GridLon0;
+static int GridRows, GridCols;
+static int *CellStart; // offsets into CellVolumes, one per cell plus one
+static int *CellVolumes;
+
+static const char *AirspaceSource;
+static int AirspaceLine;
+
+static void
+AirspaceError(const char *message, const char *token)
+{
+	fprintf(stderr, "%s:%d: %s%s%s\n", AirspaceSource, AirspaceLine, message, token ? " " : "", token ? token : "");
+	exit(1);
+}
+
+static double
+Number(const char *token)
+{
+	char *end;
+	double value;
+
+	if (token == 0)
+		AirspaceError("expected a number, got end of line", 0);
+	value = strtod(token, &end);
+	if (end == token || *end != '\0')
+		AirspaceError("expected a number, got", token);
+
+	return value;
+}
+
+static void
+AddVertex(double latitude, double longitude)
+{
+	airspace_volume_t *volume;
+
+	if (latitude < -90.0 || latitude > 90.0 || longitude < -180.0 || longitude > 180.0)
+		AirspaceError("vertex out of range", 0);
+	if (VertexCount == VertexAlloc)
+	{
+		VertexAlloc = VertexAlloc ? VertexAlloc * 2 : 256;
+		assert((Vertices = realloc(Vertices, VertexAlloc * sizeof(airspace_vertex_t))) != 0);
+	}
+	Vertices[VertexCount].latitude = latitude;
+	Vertices[VertexCount].longitude = longitude;
+	++VertexCount;
+
+	volume = &Volumes[VolumeCount - 1];
+	if (volume->vertex_count++ == 0)
+	{
+		volume->min_lat = volume->max_lat = latitude;
+		volume->min_lon = volume->max_lon = longitude;
+	}
+	volume->min_lat = fminf(volume->min_lat, latitude);
+	volume->max_lat = fmaxf(volume->max_lat, latitude);
+	volume->min_lon = fminf(volume->min_lon, longitude);
+	volume->max_lon = fmaxf(volume->max_lon, longitude);
+}
+
+// Starts a volume from its airspace line, returns 1 when polygon vertices
+// follow.
+
+static int
+CompileAirspace(char **save)
+{
+	int i;
+	char *name, *class, *token;
+	int32_t floor_ft, ceiling_ft;
+	double latitude, longitude, radius, angle;
+	airspace_volume_t *volume;
+
+	if ((name = strtok_r(0, " \t\r\n", save)) == 0 || (class = strtok_r(0, " \t\r\n", save)) == 0)
+		AirspaceError("airspace needs a name and a class", 0);
+	floor_ft = Number(strtok_r(0, " \t\r\n", save));
+	ceiling_ft = Number(strtok_r(0, " \t\r\n", save));
+	if (ceiling_ft < floor_ft)
+		AirspaceError("ceiling below floor in", name);
+	if (VolumeCount == VolumeAlloc)
+	{
+		VolumeAlloc = VolumeAlloc ? VolumeAlloc * 2 : 32;
+		assert((Volumes = realloc(Volumes, VolumeAlloc * sizeof(airspace_volume_t))) != 0);
+	}
+	volume = &Volumes[VolumeCount++];
+	snprintf(volume->name, sizeof(volume->name), "%s", name);
+	volume->first_vertex = VertexCount;
+	volume->vertex_count = 0;
+	if (strcmp(class, "B") == 0)
+	{
+		volume->low = floor_ft > 0 ? INT32_MIN : 1; // nothing underneath a surface area
+		volume->high = floor_ft - 1;
+	}
+	else if (strcmp(class, "C") == 0 || strcmp(class, "D") == 0)
+	{
+		volume->low = floor_ft;
+		volume->high = ceiling_ft;
+	}
+	else
+		AirspaceError("class must be B, C or D, got", class);
+
+	if ((token = strtok_r(0, " \t\r\n", save)) == 0)
+		return 1;
+	if (strcmp(token, "circle") != 0)
+		AirspaceError("expected circle or end of line, got", token);
+	latitude = Number(strtok_r(0, " \t\r\n", save));
+	longitude = Number(strtok_r(0, " \t\r\n", save));
+	radius = Number(strtok_r(0, " \t\r\n", save));
+	token = strtok_r(0, " \t\r\n", save);
+	if (token && strcmp(token, "mi") == 0)
+		radius /= 1.15078;
+	else if (token == 0 || strcmp(token, "nm") != 0)
+		AirspaceError("circle radius needs nm or mi", token);
+	if (strtok_r(0, " \t\r\n", save))
+		AirspaceError("trailing text after airspace", 0);
+	radius /= 60.0; // degrees of latitude
+	for (i = 0; i < AIRSPACE_CIRCLE_VERTICES; ++i)
+	{
+		angle = 2.0 * M_PI * i / AIRSPACE_CIRCLE_VERTICES;
+		AddVertex(latitude + radius * cos(angle), longitude + radius * sin(angle) / cos(latitude * M_PI / 180.0));
+	}
+
+	return 0;
+}
+
+static void
+CellRange(const airspace_volume_t *volume, int *row0, int *row1, int *col0, int *col1)
+{
+	*row0 = floor((volume->min_lat - GridLat0) / AIRSPACE_CELL);
+	*row1 = floor((volume->max_lat - GridLat0) / AIRSPACE_CELL);
+	*col0 = floor((volume->min_lon - GridLon0) / AIRSPACE_CELL);
+	*col1 = floor((volume->max_lon - GridLon0) / AIRSPACE_CELL);
+}
+
+static void
+BuildIndex(void)
+{
+	int i, row, col, row0, row1, col0, col1, cells;
+	int *fill;
+	double max_lat, max_lon;
+	const airspace_volume_t *volume;
+
+	GridRows = GridCols = 0;
+	GridLat0 = 90.0;
+	GridLon0 = 180.0;
+	max_lat = -90.0;
+	max_lon = -180.0;
+	for (i = 0; i < VolumeCount; ++i)
+	{
+		volume = &Volumes[i];
+		if (volume->low > volume->high)
+			continue;
+		GridLat0 = fmin(GridLat0, volume->min_lat);
+		GridLon0 = fmin(GridLon0, volume->min_lon);
+		max_lat = fmax(max_lat, volume->max_lat);
+		max_lon = fmax(max_lon, volume->max_lon);
+	}
+	if (max_lat < GridLat0)
+		return;
+	GridRows = floor((max_lat - GridLat0) / AIRSPACE_CELL) + 1;
+	GridCols = floor((max_lon - GridLon0) / AIRSPACE_CELL) + 1;
+	if ((int64_t)GridRows * GridCols > AIRSPACE_CELLS_MAX)
+	{
+		fprintf(stderr, "%s: airspace in %s spreads over too large an area\n", __PRETTY_FUNCTION__, AirspaceSource);
+		exit(1);
+	}
+	cells = GridRows * GridCols;
+
+	assert((CellStart = calloc(cells + 1, sizeof(int))) != 0);
+	for (i = 0; i < VolumeCount; ++i)
+		if (Volumes[i].low <= Volumes[i].high)
+		{
+			CellRange(&Volumes[i], &row0, &row1, &col0, &col1);
+			for (row = row0; row <= row1; ++row)
+				for (col = col0; col <= col1; ++col)
+					++CellStart[row * GridCols + col + 1];
+		}
+	for (i = 0; i < cells; ++i)
+		CellStart[i + 1] += CellStart[i];
+
+	assert((CellVolumes = malloc((CellStart[cells] + 1) * sizeof(int))) != 0);
+	assert((fill = malloc(cells * sizeof(int))) != 0);
+	memcpy(fill, CellStart, cells * sizeof(int));
+	for (i = 0; i < VolumeCount; ++i)
+		if (Volumes[i].low <= Volumes[i].high)
+		{
+			CellRange(&Volumes[i], &row0, &row1, &col0, &col1);
+			for (row = row0; row <= row1; ++row)
+				for (col = col0; col <= col1; ++col)
+					CellVolumes[fill[row * GridCols + col]++] = i;
+		}
+	free(fill);
+}
+
+void
+AirspaceLoad(const char *filename)
+{
+	FILE *fp;
+	char line[1024];
+	char *token, *save;
+	int polygon;
+
+	if ((fp = fopen(filename, "r")) == 0)
+	{
+		fprintf(stderr, "%s: cannot read airspace %s\n", __PRETTY_FUNCTION__, filename);
+		exit(1);
+	}
+	AirspaceSource = filename;
+	AirspaceLine = 0;
+	polygon = 0;
+	while (fgets(line, sizeof(line), fp))
+	{
+		++AirspaceLine;
+		if ((token = strchr(line, '#')) != 0)
+			*token = '\0';
+		if ((token = strtok_r(line, " \t\r\n", &save)) == 0)
+			continue;
+		if (polygon && strcmp(token, "end") == 0)
+		{
+			if (Volumes[VolumeCount - 1].vertex_count < 3)
+				AirspaceError("polygon needs at least 3 vertices in", Volumes[VolumeCount - 1].name);
+			polygon = 0;
+		}
+		else if (polygon)
+		{
+			AddVertex(Number(token), Number(strtok_r(0, " \t\r\n", &save)));
+			if (strtok_r(0, " \t\r\n", &save))
+				AirspaceError("trailing text after vertex", 0);
+		}
+		else if (strcmp(token, "airspace") == 0)
+			polygon = CompileAirspace(&save);
+		else
+			AirspaceError("expected airspace, got", token);
+	}
+	fclose(fp);
+	if (polygon)
+		AirspaceError("missing end of polygon", Volumes[VolumeCount - 1].name);
+	BuildIndex();
+}
+
+static int
+InPolygon(const airspace_volume_t *volume, float latitude, float longitude)
+{
+	int i, j, inside;
+	const airspace_vertex_t *v;
+
+	v = &Vertices[volume->first_vertex];
+	inside = 0;
+	for (i = 0, j = volume->vertex_count - 1; i < volume->vertex_count; j = i++)
+		if ((v[i].latitude > latitude) != (v[j].latitude > latitude) &&
+		    longitude < v[i].longitude + (v[j].longitude - v[i].longitude) * (latitude - v[i].latitude) / (v[j].latitude - v[i].latitude))
+			inside = ! inside;
+
+	return inside;
+}
+
+// Indicated speed limit at a position, default_cas unless the plane is in
+// or under airspace with a lower one.
+
+int32_t
+AirspaceLimit(float latitude, float longitude, int32_t altitude, int32_t default_cas)
+{
+	int row, col, i, end;
+	const airspace_volume_t *volume;
+
+	if (default_cas <= AIRSPACE_LIMIT_CAS)
+		return default_cas;
+	row = floor((latitude - GridLat0) / AIRSPACE_CELL);
+	col = floor((longitude - GridLon0) / AIRSPACE_CELL);
+	if (row < 0 || row >= GridRows || col < 0 || col >= GridCols)
+		return default_cas;
+	end = CellStart[row * GridCols + col + 1];
+	for (i = CellStart[row * GridCols + col]; i < end; ++i)
+	{
+		volume = &Volumes[CellVolumes[i]];
+		if (altitude >= volume->low && altitude <= volume->high &&
+		    latitude >= volume->min_lat && latitude <= volume->max_lat &&
+		    longitude >= volume->min_lon && longitude <= volume->max_lon &&
+		    InPolygon(volume, latitude, longitude))
+			return AIRSPACE_LIMIT_CAS;
+	}
+
+	return default_cas;
+}
@@ -0,0 +1,2 @@
+extern void AirspaceLoad(const char *filename);
+extern int32_t AirspaceLimit(float latitude, float longitude, int32_t altitude, int32_t default_cas);
@@ -0,0 +1,525 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "tracker.h"
+#include "sketch.h"
+#include "heatmap.h"
+#include "batch.h"
+
+// Offline processing of saved BaseStation logs on a pool of threads.
+//
+// Each file is split into line aligned chunks. A worker replays the
+// LOOKBACK_SECONDS of log before its chunk with shadow planes so it knows
+// which aircraft were already being tracked at the boundary; those belong
+// to the previous chunk. After reaching the end of its chunk the worker
+// keeps reading, following only the planes it owns, until the last one
+// flies out of range. Both workers see the same squitters across the
+// boundary so every flight is tracked start to finish by exactly one of
+// them, and the merged violations match a serial run over the same file.
+//
+// The files are taken to follow on from each other in the order given,
+// e.g. daily logs, and are tracked as if they were one log: the first
+// chunk of a file looks back into the end of the file before, and a
+// worker follows its planes on into the next file.
+
+#define CHUNKS_PER_THREAD 4 // some slack for uneven chunks
+#define MIN_CHUNK_SIZE (1 << 20)
+#define LOOKBACK_SECONDS 60 // well past the tracker's 10 second clean
+#define ALTITUDE_BANDS 11 // 1000 ft bands, the last one catches anything higher
+
+typedef struct violation_t {
+	int file;
+	off_t offset; // line that retired the plane
+	plane_t plane;
+} violation_t;
+
+typedef struct chunk_t {
+	int file;
+	off_t start; // [start, end), both at the start of a line
+	off_t end;
+	int line_file; // where the line being tracked is, maybe past the chunk's own file
+	off_t line_offset;
+	violation_t *violations;
+	int violation_count;
+	int violation_size;
+} chunk_t;
+
+typedef struct batch_t {
+	char **files;
+	int file_count;
+	chunk_t *chunks;
+	int chunk_count;
+	int next_chunk;
+	sketch_set_t *sketches; // optional, the workers' sketches are merged into it
+	heatmap_t *heatmap; // ...and heatmaps
+	pthread_mutex_t mutex;
+} batch_t;
+
+typedef struct aggregate_t {
+	char key[8];
+	uint32_t count;
+	double naughty_sum;
+	double naughty_max;
+} aggregate_t;
+
+static void
+BatchRetire(tracker_t *tracker, plane_t *plane)
+{
+	chunk_t *chunk;
+
+	chunk = tracker->context;
+	if (chunk->violation_count == chunk->violation_size)
+	{
+		chunk->violation_size = chunk->violation_size ? chunk->violation_size * 2 : 64;
+		assert((chunk->violations = realloc(chunk->violations, chunk->violation_size * sizeof(violation_t))) != 0);
+	}
+	chunk->violations[chunk->violation_count].file = chunk->line_file;
+	chunk->violations[chunk->violation_count].offset = chunk->line_offset;
+	chunk->violations[chunk->violation_count].plane = *plane;
+	++chunk->violation_count;
+}
+
+static void
+SkipPartialLine(FILE *fp)
+{
+	int c;
+
+	while ((c = getc(fp)) != EOF && c != '\n')
+		;
+}
+
+// Offset of a line at least LOOKBACK_SECONDS of receiver time before the
+// last timestamped line preceding start.
+
+static off_t
+LookbackStart(FILE *fp, off_t start)
+{
+	off_t from, window, lookback;
+	time_t first_time, last_time, t;
+	char buffer[1024];
+
+	window = 1 << 16;
+	for (;;)
+	{
+		from = start - window;
+		if (from < 0)
+			from = 0;
+		fseeko(fp, from, SEEK_SET);
+		if (from > 0)
+			SkipPartialLine(fp);
+		lookback = ftello(fp);
+		first_time = -1;
+		last_time = -1;
+		while (ftello(fp) < start && fgets(buffer, sizeof(buffer), fp))
+			if ((t = TrackerLineTime(buffer)) != -1)
+			{
+				if (first_time == -1)
+					first_time = t;
+				last_time = t;
+			}
+		if (from == 0 || (first_time != -1 && first_time < last_time - LOOKBACK_SECONDS))
+			return lookback;
+		window *= 2;
+	}
+}
+
+static void
+DropShadowPlanes(tracker_t *tracker)
+{
+	int i, last_valid_plane;
+
+	last_valid_plane = -1;
+	for (i = 0; i < tracker->plane_list_count; ++i)
+		if (tracker->planes[i].valid)
+		{
+			if (tracker->planes[i].shadow)
+				tracker->planes[i].valid = 0;
+			else
+				last_valid_plane = i;
+		}
+	tracker->plane_list_count = last_valid_plane + 1;
+}
+
+static FILE *
+OpenLog(batch_t *batch, int file)
+{
+	FILE *fp;
+
+	if ((fp = fopen(batch->files[file], "r")) == 0)
+	{
+		perror(batch->files[file]);
+		exit(1);
+	}
+
+	return fp;
+}
+
+// Replays the lines of fp up to end, inserting any new planes as shadows.
+
+static void
+ReplayShadows(tracker_t *tracker, FILE *fp, off_t end)
+{
+	char buffer[1024];
+
+	tracker->insert_shadow = 1;
+	while (ftello(fp) < end && fgets(buffer, sizeof(buffer), fp))
+		TrackerLine(tracker, buffer);
+	tracker->insert_shadow = 0;
+}
+
+static void
+ProcessChunk(batch_t *batch, chunk_t *chunk, tracker_t *tracker, sketch_set_t *sketches, heatmap_t *heatmap)
+{
+	FILE *fp;
+	int file;
+	off_t offset, end;
+	char buffer[1024];
+
+	TrackerInit(tracker, BatchRetire, chunk);
+	tracker->sketches = sketches;
+	tracker->heatmap = heatmap;
+	if (chunk->start == 0 && chunk->file > 0)
+	{
+		// the look back is the end of the file before
+		fp = OpenLog(batch, chunk->file - 1);
+		fseeko(fp, 0, SEEK_END);
+		end = ftello(fp);
+		fseeko(fp, LookbackStart(fp, end), SEEK_SET);
+		ReplayShadows(tracker, fp, end);
+		fclose(fp);
+	}
+	fp = OpenLog(batch, chunk->file);
+	if (chunk->start > 0)
+	{
+		fseeko(fp, LookbackStart(fp, chunk->start), SEEK_SET);
+		ReplayShadows(tracker, fp, chunk->start);
+	}
+
+	fseeko(fp, chunk->start, SEEK_SET);
+	offset = chunk->start;
+	chunk->line_file = chunk->file;
+	while (offset < chunk->end && fgets(buffer, sizeof(buffer), fp))
+	{
+		chunk->line_offset = offset;
+		TrackerLine(tracker, buffer);
+		offset = ftello(fp);
+	}
+
+	// follow our own planes into the next chunk, and on into the next
+	// file, until they are out of range
+	DropShadowPlanes(tracker);
+	tracker->no_insert = 1;
+	file = chunk->file;
+	while (tracker->plane_list_count > 0)
+	{
+		if (fgets(buffer, sizeof(buffer), fp) == 0)
+		{
+			fclose(fp);
+			fp = 0;
+			if (++file == batch->file_count)
+				break;
+			fp = OpenLog(batch, file);
+			offset = 0;
+			continue;
+		}
+		chunk->line_file = file;
+		chunk->line_offset = offset;
+		TrackerLine(tracker, buffer);
+		offset = ftello(fp);
+	}
+	if (fp)
+		fclose(fp);
+}
+
+static void *
+BatchWorker(void *arg)
+{
+	batch_t *batch;
+	tracker_t *tracker;
+	sketch_set_t *sketches;
+	heatmap_t *heatmap;
+	int chunk_index;
+
+	batch = arg;
+	assert((tracker = malloc(sizeof(tracker_t))) != 0);
+	sketches = 0;
+	if (batch->sketches)
+	{
+		sketches = SketchNew(0, 0);
+		memcpy(sketches->zone_names, batch->sketches->zone_names, sizeof(sketches->zone_names));
+	}
+	heatmap = batch->heatmap ? HeatmapNew(0, 0) : 0;
+	for (;;)
+	{
+		pthread_mutex_lock(&batch->mutex);
+		chunk_index = batch->next_chunk++;
+		pthread_mutex_unlock(&batch->mutex);
+		if (chunk_index >= batch->chunk_count)
+			break;
+		ProcessChunk(batch, &batch->chunks[chunk_index], tracker, sketches, heatmap);
+	}
+	free(tracker);
+	if (sketches)
+	{
+		pthread_mutex_lock(&batch->mutex);
+		SketchMerge(batch->sketches, sketches);
+		pthread_mutex_unlock(&batch->mutex);
+		free(sketches);
+	}
+	if (heatmap)
+	{
+		pthread_mutex_lock(&batch->mutex);
+		HeatmapMerge(batch->heatmap, heatmap);
+		pthread_mutex_unlock(&batch->mutex);
+		free(heatmap);
+	}
+
+	return 0;
+}
+
+static off_t
+AlignToLine(FILE *fp, off_t offset, off_t size)
+{
+	if (offset <= 0)
+		return 0;
+	if (offset >= size)
+		return size;
+	fseeko(fp, offset - 1, SEEK_SET);
+	SkipPartialLine(fp);
+
+	return ftello(fp);
+}
+
+static void
+SplitFiles(batch_t *batch, int file_count, int threads)
+{
+	int i, j, pieces;
+	off_t total_size, chunk_size, start, end;
+	off_t *sizes;
+	struct stat statbuf;
+	FILE *fp;
+
+	assert((sizes = malloc(file_count * sizeof(off_t))) != 0);
+	total_size = 0;
+	for (i = 0; i < file_count; ++i)
+	{
+		if (stat(batch->files[i], &statbuf))
+		{
+			perror(batch->files[i]);
+			exit(1);
+		}
+		sizes[i] = statbuf.st_size;
+		total_size += sizes[i];
+	}
+	chunk_size = total_size / (threads * CHUNKS_PER_THREAD);
+	if (chunk_size < MIN_CHUNK_SIZE)
+		chunk_size = MIN_CHUNK_SIZE;
+
+	batch->chunk_count = 0;
+	batch->chunks = 0;
+	for (i = 0; i < file_count; ++i)
+	{
+		fp = OpenLog(batch, i);
+		pieces = (sizes[i] + chunk_size - 1) / chunk_size;
+		assert((batch->chunks = realloc(batch->chunks, (batch->chunk_count + pieces) * sizeof(chunk_t))) != 0);
+		start = 0;
+		for (j = 1; j <= pieces; ++j)
+		{
+			end = AlignToLine(fp, j * chunk_size, sizes[i]);
+			if (end <= start)
+				continue;
+			memset(&batch->chunks[batch->chunk_count], 0, sizeof(chunk_t));
+			batch->chunks[batch->chunk_count].file = i;
+			batch->chunks[batch->chunk_count].start = start;
+			batch->chunks[batch->chunk_count].end = end;
+			++batch->chunk_count;
+			start = end;
+		}
+		fclose(fp);
+	}
+	free(sizes);
+}
+
+static int
+CompareViolations(const void *a, const void *b)
+{
+	const violation_t *va = a, *vb = b;
+
+	if (va->file != vb->file)
+		return va->file < vb->file ? -1 : 1;
+	if (va->offset != vb->offset)
+		return va->offset < vb->offset ? -1 : 1;
+	if (va->plane.icao != vb->plane.icao)
+		return va->plane.icao < vb->plane.icao ? -1 : 1;
+
+	return 0;
+}
+
+static void
+Aggregate(aggregate_t *aggregate, double naughty)
+{
+	if (aggregate->count == 0 || naughty > aggregate->naughty_max)
+		aggregate->naughty_max = naughty;
+	aggregate->naughty_sum += naughty;
+	++aggregate->count;
+}
+
+static aggregate_t *
+FindAirline(aggregate_t **airlines, int *airline_count, const char *callsign)
+{
+	int i;
+	char key[8];
+
+	// ICAO airline designator, anything else is lumped together
+	if (isalpha(callsign[0]) && isalpha(callsign[1]) && isalpha(callsign[2]) && isdigit(callsign[3]))
+	{
+		memcpy(key, callsign, 3);
+		key[3] = '\0';
+	}
+	else
+		strcpy(key, "other");
+	for (i = 0; i < *airline_count; ++i)
+		if (strcmp((*airlines)[i].key, key) == 0)
+			return &(*airlines)[i];
+	assert((*airlines = realloc(*airlines, (*airline_count + 1) * sizeof(aggregate_t))) != 0);
+	memset(&(*airlines)[i], 0, sizeof(aggregate_t));
+	strcpy((*airlines)[i].key, key);
+	++*airline_count;
+
+	return &(*airlines)[i];
+}
+
+static int
+CompareAggregates(const void *a, const void *b)
+{
+	const aggregate_t *aa = a, *ab = b;
+
+	if (aa->count != ab->count)
+		return aa->count > ab->count ? -1 : 1;
+
+	return strcmp(aa->key, ab->key);
+}
+
+static void
+PrintAggregates(const char *title, aggregate_t *aggregates, int count)
+{
+	int i;
+
+	printf("%s:\n", title);
+	for (i = 0; i < count; ++i)
+		if (aggregates[i].count > 0)
+			printf("%25s: %d (nv avg %4.1f, max %4.1f)\n",
+			       aggregates[i].key,
+			       aggregates[i].count,
+			       aggregates[i].naughty_sum / (double)aggregates[i].count,
+			       aggregates[i].naughty_max);
+}
+
+static void
+ReportAggregates(violation_t *violations, int violation_count)
+{
+	int i, band, airline_count;
+	struct tm tm;
+	aggregate_t hours[24];
+	aggregate_t bands[ALTITUDE_BANDS];
+	aggregate_t *airlines;
+	plane_t *plane;
+
+	memset(hours, 0, sizeof(hours));
+	for (i = 0; i < 24; ++i)
+		sprintf(hours[i].key, "%02d:00", i);
+	memset(bands, 0, sizeof(bands));
+	for (i = 0; i < ALTITUDE_BANDS; ++i)
+		sprintf(bands[i].key, "%d%s", i * 1000, i == ALTITUDE_BANDS - 1 ? "+" : "");
+	airlines = 0;
+	airline_count = 0;
+
+	for (i = 0; i < violation_count; ++i)
+	{
+		plane = &violations[i].plane;
+		localtime_r(&plane->fastest.seen, &tm);
+		Aggregate(&hours[tm.tm_hour], plane->fastest.naughty);
+		band = plane->fastest.altitude / 1000;
+		if (band < 0)
+			band = 0;
+		else if (band >= ALTITUDE_BANDS)
+			band = ALTITUDE_BANDS - 1;
+		Aggregate(&bands[band], plane->fastest.naughty);
+		Aggregate(FindAirline(&airlines, &airline_count, plane->callsign), plane->fastest.naughty);
+	}
+
+	printf("Batch report, %d speeders:\n", violation_count);
+	qsort(airlines, airline_count, sizeof(aggregate_t), CompareAggregates);
+	PrintAggregates("by airline", airlines, airline_count);
+	PrintAggregates("by hour", hours, 24);
+	PrintAggregates("by altitude band (ft MSL)", bands, ALTITUDE_BANDS);
+	free(airlines);
+}
+
+int
+BatchRun(char **files, int file_count, int threads, void (*report)(plane_t *plane), sketch_set_t *sketches, heatmap_t *heatmap)
+{
+	int i, violation_count;
+	batch_t batch;
+	pthread_t *workers;
+	violation_t *violations;
+
+	batch.files = files;
+	batch.file_count = file_count;
+	SplitFiles(&batch, file_count, threads);
+	batch.next_chunk = 0;
+	batch.sketches = sketches;
+	batch.heatmap = heatmap;
+	pthread_mutex_init(&batch.mutex, 0);
+	if (threads > batch.chunk_count)
+		threads = batch.chunk_count;
+
+	assert((workers = malloc((threads + 1) * sizeof(pthread_t))) != 0);
+	for (i = 0; i < threads; ++i)
+		if (pthread_create(&workers[i], 0, BatchWorker, &batch))
+		{
+			perror(__PRETTY_FUNCTION__);
+			exit(1);
+		}
+	for (i = 0; i < threads; ++i)
+		pthread_join(workers[i], 0);
+	free(workers);
+	pthread_mutex_destroy(&batch.mutex);
+
+	violation_count = 0;
+	for (i = 0; i < batch.chunk_count; ++i)
+		violation_count += batch.chunks[i].violation_count;
+	assert((violations = malloc((violation_count + 1) * sizeof(violation_t))) != 0);
+	violation_count = 0;
+	for (i = 0; i < batch.chunk_count; ++i)
+	{
+		if (batch.chunks[i].violation_count == 0)
+			continue; // never allocated
+		memcpy(&violations[violation_count], batch.chunks[i].violations, batch.chunks[i].violation_count * sizeof(violation_t));
+		violation_count += batch.chunks[i].violation_count;
+		free(batch.chunks[i].violations);
+	}
+	free(batch.chunks);
+	qsort(violations, violation_count, sizeof(violation_t), CompareViolations);
+
+	for (i = 0; i < violation_count; ++i)
+		report(&violations[i].plane);
+	ReportAggregates(violations, violation_count);
+	free(violations);
+	if (sketches)
+	{
+		SketchReport(sketches);
+		SketchSave(sketches);
+	}
+	if (heatmap)
+		HeatmapSave(heatmap);
+
+	return 0;
+}
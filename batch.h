@@ -0,0 +1 @@
+extern int BatchRun(char **files, int file_count, int threads, void (*report)(plane_t *plane), sketch_set_t *sketches, heatmap_t *heatmap);
@@ -0,0 +1,508 @@
+#define _GNU_SOURCE // accept4
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "registry.h"
+#include "tracker.h"
+#include "rules.h"
+#include "feed.h"
+
+// Live feed of plane updates and violations as server-sent events on a
+// local port, e.g. curl -N http://localhost:30333/events
+//
+// The tracker serialises each event once into a refcounted message and
+// queues it for the feed thread, which fans it out to every client from
+// an epoll loop. Only the feed thread touches client state and
+// refcounts. A client that falls behind first loses plane updates, and
+// is dropped if it cannot keep up with violations either, so a slow
+// reader never holds up the tracker.
+
+#define FEED_CLIENTS 64
+#define FEED_QUEUE_LEN 256 // messages queued per client
+#define FEED_DOWNSAMPLE (FEED_QUEUE_LEN / 2) // above this plane updates are skipped
+#define FEED_PENDING_MAX 4096 // messages waiting for the feed thread
+#define FEED_INTERVAL 1 // seconds between updates for one plane
+#define FEED_EVENTS 64
+
+typedef struct feed_message_t {
+	struct feed_message_t *next;
+	int refcount;
+	int droppable; // plane update, may be skipped for a slow client
+	size_t len;
+	char data[];
+} feed_message_t;
+
+typedef struct feed_client_t {
+	struct feed_client_t *next_closed;
+	int fd; // -1 once closed
+	int streaming;
+	int want_write;
+	char request[1024];
+	int request_len;
+	feed_message_t *queue[FEED_QUEUE_LEN];
+	int head;
+	int count;
+	size_t sent; // bytes of queue[head] already written
+} feed_client_t;
+
+typedef struct feed_t {
+	int started;
+	int listen_fd;
+	int event_fd;
+	int epoll_fd;
+	int streaming_count; // read by the tracker without the lock
+	feed_client_t *clients[FEED_CLIENTS];
+	int client_count;
+	feed_client_t *closed; // freed once the current batch of events is done
+	feed_message_t *header;
+	pthread_mutex_t mutex; // protects the pending list
+	feed_message_t *pending_head;
+	feed_message_t *pending_tail;
+	int pending_count;
+} feed_t;
+
+static feed_t Feed = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER
+};
+
+static const char FeedHeader[] =
+	"HTTP/1.1 200 OK\r\n"
+	"Content-Type: text/event-stream\r\n"
+	"Cache-Control: no-cache\r\n"
+	"Connection: keep-alive\r\n"
+	"Access-Control-Allow-Origin: *\r\n"
+	"\r\n";
+
+static const char FeedNotFound[] =
+	"HTTP/1.1 404 Not Found\r\n"
+	"Content-Length: 0\r\n"
+	"Connection: close\r\n"
+	"\r\n";
+
+static feed_message_t *
+NewMessage(const char *data, size_t len, int droppable)
+{
+	feed_message_t *message;
+
+	assert((message = malloc(sizeof(feed_message_t) + len)) != 0);
+	message->next = 0;
+	message->refcount = 1;
+	message->droppable = droppable;
+	message->len = len;
+	memcpy(message->data, data, len);
+
+	return message;
+}
+
+static void
+ReleaseMessage(feed_message_t *message)
+{
+	if (--message->refcount == 0)
+		free(message);
+}
+
+static void
+CloseClient(feed_client_t *client)
+{
+	int i;
+
+	while (client->count > 0)
+	{
+		ReleaseMessage(client->queue[client->head]);
+		client->head = (client->head + 1) % FEED_QUEUE_LEN;
+		--client->count;
+	}
+	close(client->fd);
+	client->fd = -1;
+	if (client->streaming)
+		__atomic_sub_fetch(&Feed.streaming_count, 1, __ATOMIC_RELAXED);
+	for (i = 0; i < Feed.client_count; ++i)
+		if (Feed.clients[i] == client)
+		{
+			Feed.clients[i] = Feed.clients[--Feed.client_count];
+			break;
+		}
+	client->next_closed = Feed.closed;
+	Feed.closed = client;
+}
+
+static void
+WantWrite(feed_client_t *client, int want_write)
+{
+	struct epoll_event event;
+
+	if (client->want_write == want_write)
+		return;
+	event.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+	event.data.ptr = client;
+	epoll_ctl(Feed.epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+	client->want_write = want_write;
+}
+
+// Returns 0 if the client had to be closed.
+
+static int
+FlushClient(feed_client_t *client)
+{
+	ssize_t n;
+	feed_message_t *message;
+
+	while (client->count > 0)
+	{
+		message = client->queue[client->head];
+		n = send(client->fd, message->data + client->sent, message->len - client->sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				WantWrite(client, 1);
+				return 1;
+			}
+			if (errno == EINTR)
+				continue;
+			CloseClient(client);
+			return 0;
+		}
+		client->sent += n;
+		if (client->sent == message->len)
+		{
+			ReleaseMessage(message);
+			client->head = (client->head + 1) % FEED_QUEUE_LEN;
+			--client->count;
+			client->sent = 0;
+		}
+	}
+	WantWrite(client, 0);
+
+	return 1;
+}
+
+// Returns 0 if the client had to be closed.
+
+static int
+QueueMessage(feed_client_t *client, feed_message_t *message)
+{
+	if (message->droppable && client->count >= FEED_DOWNSAMPLE)
+		return 1;
+	if (client->count == FEED_QUEUE_LEN)
+	{
+		CloseClient(client); // hopelessly behind
+		return 0;
+	}
+	client->queue[(client->head + client->count) % FEED_QUEUE_LEN] = message;
+	++client->count;
+	++message->refcount;
+
+	return 1;
+}
+
+static void
+FanOut(void)
+{
+	int i;
+	uint64_t value;
+	feed_message_t *message, *next;
+
+	if (read(Feed.event_fd, &value, sizeof(value)) < 0)
+		return;
+	pthread_mutex_lock(&Feed.mutex);
+	message = Feed.pending_head;
+	Feed.pending_head = Feed.pending_tail = 0;
+	Feed.pending_count = 0;
+	pthread_mutex_unlock(&Feed.mutex);
+
+	for (; message; message = next)
+	{
+		next = message->next;
+		for (i = Feed.client_count - 1; i >= 0; --i) // closing a client moves the last one down
+			if (Feed.clients[i]->streaming)
+				QueueMessage(Feed.clients[i], message);
+		ReleaseMessage(message);
+	}
+	for (i = Feed.client_count - 1; i >= 0; --i)
+		if (Feed.clients[i]->count > 0 && ! Feed.clients[i]->want_write)
+			FlushClient(Feed.clients[i]);
+}
+
+static void
+AcceptClients(void)
+{
+	int fd;
+	feed_client_t *client;
+	struct epoll_event event;
+
+	while ((fd = accept4(Feed.listen_fd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		if (Feed.client_count == FEED_CLIENTS)
+		{
+			close(fd);
+			continue;
+		}
+		assert((client = calloc(1, sizeof(feed_client_t))) != 0);
+		client->fd = fd;
+		event.events = EPOLLIN;
+		event.data.ptr = client;
+		epoll_ctl(Feed.epoll_fd, EPOLL_CTL_ADD, fd, &event);
+		Feed.clients[Feed.client_count++] = client;
+	}
+}
+
+static void
+ReadClient(feed_client_t *client)
+{
+	ssize_t n;
+	char discard[256];
+
+	if (client->streaming)
+	{
+		// nothing more is expected from the client, just notice it leaving
+		while ((n = recv(client->fd, discard, sizeof(discard), MSG_DONTWAIT)) > 0)
+			;
+		if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+			CloseClient(client);
+		return;
+	}
+
+	n = recv(client->fd, client->request + client->request_len, sizeof(client->request) - 1 - client->request_len, MSG_DONTWAIT);
+	if (n <= 0)
+	{
+		if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+			CloseClient(client);
+		return;
+	}
+	client->request_len += n;
+	client->request[client->request_len] = '\0';
+	if (strstr(client->request, "\r\n\r\n") == 0 && strstr(client->request, "\n\n") == 0)
+	{
+		if (client->request_len == sizeof(client->request) - 1)
+			CloseClient(client);
+		return;
+	}
+	if (strncmp(client->request, "GET / ", 6) != 0 && strncmp(client->request, "GET /events", 11) != 0)
+	{
+		send(client->fd, FeedNotFound, sizeof(FeedNotFound) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+		CloseClient(client);
+		return;
+	}
+	client->streaming = 1;
+	__atomic_add_fetch(&Feed.streaming_count, 1, __ATOMIC_RELAXED);
+	if (QueueMessage(client, Feed.header))
+		FlushClient(client);
+}
+
+static void *
+FeedLoop(void *arg)
+{
+	int i, n;
+	feed_client_t *client;
+	struct epoll_event events[FEED_EVENTS];
+
+	for (;;)
+	{
+		n = epoll_wait(Feed.epoll_fd, events, FEED_EVENTS, -1);
+		for (i = 0; i < n; ++i)
+			if (events[i].data.ptr == &Feed.listen_fd)
+				AcceptClients();
+			else if (events[i].data.ptr == &Feed.event_fd)
+				FanOut();
+			else
+			{
+				client = events[i].data.ptr;
+				if (client->fd < 0)
+					continue;
+				if (events[i].events & (EPOLLERR | EPOLLHUP))
+					CloseClient(client);
+				else if (events[i].events & EPOLLIN)
+					ReadClient(client);
+				else if (events[i].events & EPOLLOUT)
+					FlushClient(client);
+			}
+		while ((client = Feed.closed) != 0)
+		{
+			Feed.closed = client->next_closed;
+			free(client);
+		}
+	}
+
+	return 0;
+}
+
+static void
+Publish(const char *data, size_t len, int droppable)
+{
+	feed_message_t *message;
+	uint64_t value;
+
+	pthread_mutex_lock(&Feed.mutex);
+	if (droppable && Feed.pending_count >= FEED_PENDING_MAX)
+	{
+		pthread_mutex_unlock(&Feed.mutex);
+		return;
+	}
+	message = NewMessage(data, len, droppable);
+	if (Feed.pending_tail)
+		Feed.pending_tail->next = message;
+	else
+		Feed.pending_head = message;
+	Feed.pending_tail = message;
+	++Feed.pending_count;
+	pthread_mutex_unlock(&Feed.mutex);
+
+	value = 1;
+	if (write(Feed.event_fd, &value, sizeof(value)) < 0)
+		perror(__PRETTY_FUNCTION__);
+}
+
+static int
+Streaming(void)
+{
+	return Feed.started && __atomic_load_n(&Feed.streaming_count, __ATOMIC_RELAXED) > 0;
+}
+
+// Callsign without the trailing padding, and nothing that needs JSON escaping.
+
+static void
+JSONCallsign(const char *callsign, char trimmed[CALLSIGN_LEN])
+{
+	int i;
+
+	for (i = 0; i < CALLSIGN_LEN - 1 && isalnum(callsign[i]); ++i)
+		trimmed[i] = callsign[i];
+	trimmed[i] = '\0';
+}
+
+void
+FeedPlane(plane_t *plane)
+{
+	int len;
+	char callsign[CALLSIGN_LEN];
+	char buffer[512];
+	int changed;
+
+	// a plane becoming a speeder is news, whatever the throttle says
+	changed = plane->speeder != plane->feed_speeder;
+	if (! Streaming() || (plane->last_seen < plane->feed_next && ! changed))
+		return;
+	plane->feed_next = plane->last_seen + FEED_INTERVAL;
+	plane->feed_speeder = plane->speeder;
+
+	JSONCallsign(plane->callsign, callsign);
+	len = snprintf(buffer, sizeof(buffer),
+		       "event: plane\n"
+		       "data: {\"icao\":\"%06X\",\"callsign\":\"%s\",\"seen\":%ld,"
+		       "\"altitude\":%d,\"speed\":%d,\"latitude\":%.4f,\"longitude\":%.4f,"
+		       "\"naughty_speed_tas\":%d,\"speeder\":%d}\n\n",
+		       plane->icao,
+		       callsign,
+		       (long int)plane->last_seen,
+		       plane->altitude,
+		       plane->speed,
+		       plane->latlong_valid ? plane->latitude : 0.0,
+		       plane->latlong_valid ? plane->longitude : 0.0,
+		       plane->naughty_speed_tas,
+		       plane->speeder);
+	Publish(buffer, len, ! changed);
+}
+
+void
+FeedViolation(const plane_t *plane)
+{
+	int len;
+	char callsign[CALLSIGN_LEN];
+	char registration[sizeof(((registry_entry_t *)0)->registration) + 1];
+	char type[sizeof(((registry_entry_t *)0)->type) + 1];
+	char operator[sizeof(((registry_entry_t *)0)->operator) + 1];
+	char buffer[1024];
+
+	if (! Streaming())
+		return;
+	JSONCallsign(plane->callsign, callsign);
+	registration[0] = type[0] = operator[0] = '\0';
+	if (plane->registry)
+	{
+		RegistryText(plane->registry->registration, sizeof(plane->registry->registration), registration, sizeof(registration));
+		RegistryText(plane->registry->type, sizeof(plane->registry->type), type, sizeof(type));
+		RegistryText(plane->registry->operator, sizeof(plane->registry->operator), operator, sizeof(operator));
+	}
+	len = snprintf(buffer, sizeof(buffer),
+		       "event: violation\n"
+		       "data: {\"icao\":\"%06X\",\"callsign\":\"%s\",\"registration\":\"%s\",\"type\":\"%s\",\"operator\":\"%s\","
+		       "\"seen\":%ld,\"altitude\":%d,\"speed\":%d,\"latitude\":%.4f,\"longitude\":%.4f,\"distance\":%.1f,"
+		       "\"naughty\":%.1f,\"naughty_speed_tas\":%d,\"limit_tas\":%d,\"rule\":\"%s\"}\n\n",
+		       plane->icao,
+		       callsign,
+		       registration,
+		       type,
+		       operator,
+		       (long int)plane->fastest.seen,
+		       plane->fastest.altitude,
+		       plane->fastest.speed,
+		       plane->fastest.latitude,
+		       plane->fastest.longitude,
+		       plane->fastest.distance,
+		       plane->fastest.naughty,
+		       plane->fastest.naughty_speed_tas,
+		       plane->fastest.limit_tas,
+		       RulesName(plane->fastest.rule));
+	Publish(buffer, len, 0);
+}
+
+void
+FeedStart(int port)
+{
+	int one;
+	pthread_t thread;
+	struct sockaddr_in addr;
+	struct epoll_event event;
+
+	one = 1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // local tools only
+	if ((Feed.listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0 ||
+	    setsockopt(Feed.listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+	    bind(Feed.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(Feed.listen_fd, 16))
+	{
+		fprintf(stderr, "%s: cannot listen on port %d: %s\n", __PRETTY_FUNCTION__, port, strerror(errno));
+		exit(1);
+	}
+	if ((Feed.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 ||
+	    (Feed.epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+	{
+		perror(__PRETTY_FUNCTION__);
+		exit(1);
+	}
+	event.events = EPOLLIN;
+	event.data.ptr = &Feed.listen_fd;
+	epoll_ctl(Feed.epoll_fd, EPOLL_CTL_ADD, Feed.listen_fd, &event);
+	event.events = EPOLLIN;
+	event.data.ptr = &Feed.event_fd;
+	epoll_ctl(Feed.epoll_fd, EPOLL_CTL_ADD, Feed.event_fd, &event);
+
+	// shared by every client, never released
+	Feed.header = NewMessage(FeedHeader, sizeof(FeedHeader) - 1, 0);
+
+	if (pthread_create(&thread, 0, FeedLoop, 0))
+	{
+		perror(__PRETTY_FUNCTION__);
+		exit(1);
+	}
+	pthread_detach(thread);
+	Feed.started = 1;
+}
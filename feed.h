@@ -0,0 +1,3 @@
+extern void FeedStart(int port);
+extern void FeedPlane(plane_t *plane);
+extern void FeedViolation(const plane_t *plane);
@@ -0,0 +1,73 @@
+#!/bin/sh
+# make check: offline regression checks, run from the top of the tree
+
+status=0
+dir=$(mktemp -d)
+export TZ=UTC
+
+# speeders over a small hand written log, name.log, against the violations
+# in name.expected
+Violations()
+{
+	name=$1
+	shift
+	if ./speeders -w http://127.0.0.1:9/%s "$@" < "fixtures/$name.log" 2>/dev/null |
+		diff -u "fixtures/$name.expected" -
+	then
+		echo "PASS fixtures/$name.log"
+	else
+		echo "FAIL fixtures/$name.log"
+		status=1
+	fi
+}
+
+# METAR parser against saved data server responses
+for xml in fixtures/metar-*.xml
+do
+	if ./tb "$xml" | diff -u "${xml%.xml}.expected" -
+	then
+		echo "PASS $xml"
+	else
+		echo "FAIL $xml"
+		status=1
+	fi
+done
+
+# registry fields with quotes and backslashes must not reach the report
+./regbuild fixtures/registry.csv "$dir/registry.bin" > /dev/null
+Violations registry -r "$dir/registry.bin"
+
+# zones, conditions and first match order of a rules file
+Violations rules -l fixtures/rules.txt
+
+# 200 kt under a Class B shelf and in Class D, 250 kt around them
+Violations airspace -a fixtures/airspace.txt
+
+# a batch run (-j) must report what a serial run of the same log does, and
+# save the same speed distributions and heatmap. The batch gets the log as
+# two files split in mid flight, so planes cross from one to the other.
+fixtures/loggen > "$dir/log"
+lines=$(wc -l < "$dir/log")
+head -n $((lines / 2)) "$dir/log" > "$dir/log.1"
+tail -n +$((lines / 2 + 1)) "$dir/log" > "$dir/log.2"
+mkdir "$dir/serial" "$dir/batch"
+./speeders -w http://127.0.0.1:9/%s -d "$dir/serial" < "$dir/log" 2>/dev/null |
+	grep '^[0-9A-F]\{6\} ' | sort > "$dir/serial.txt"
+./speeders -w http://127.0.0.1:9/%s -d "$dir/batch" -j 4 "$dir/log.1" "$dir/log.2" 2>/dev/null |
+	sed '/^Batch report/,$d' | sort > "$dir/batch.txt"
+result=PASS
+if [ ! -s "$dir/serial.txt" ] || ! diff -u "$dir/serial.txt" "$dir/batch.txt"
+then
+	result=FAIL
+fi
+for file in sketch.bin heat.bin heat.geojson
+do
+	serial=$(ls "$dir"/serial/${file%.*}-????????.${file#*.})
+	batch=$(ls "$dir"/batch/${file%.*}-????????-????????.${file#*.})
+	cmp "$serial" "$batch" || result=FAIL
+done
+echo "$result batch matches serial, $(wc -l < "$dir/serial.txt") violations"
+[ $result = PASS ] || status=1
+rm -rf "$dir"
+
+exit $status
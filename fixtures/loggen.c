@@ -0,0 +1,108 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+// Writes a repeatable synthetic BaseStation log to stdout for make check:
+// planes crossing the zone of interest at random speeds and altitudes,
+// about 40 messages a second from 06:00 UTC on 2024/06/01.
+
+#define PLANES_MAX 64
+#define MESSAGES_PER_SECOND 40.0
+#define START_TIME 1717221600 // 2024/06/01 06:00:00 UTC
+
+typedef struct fake_plane_t {
+	uint32_t icao;
+	char callsign[16];
+	double latitude;
+	double longitude;
+	double dlatitude;
+	double dlongitude;
+	int altitude;
+	int speed;
+	double end;
+} fake_plane_t;
+
+static uint64_t Seed = 88172645463325252ULL;
+
+static double
+Random(void)
+{
+	Seed ^= Seed << 13;
+	Seed ^= Seed >> 7;
+	Seed ^= Seed << 17;
+
+	return (Seed >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int
+RandomInt(int low, int high)
+{
+	return low + (int)(Random() * (high - low + 1));
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const char *airlines[] = { "SWA", "UAL", "AAL", "N12", "DAL", "SKW" };
+	static const int types[] = { 1, 3, 3, 4, 4, 5 };
+	fake_plane_t planes[PLANES_MAX], *plane;
+	int plane_count, i, duration, type, ms;
+	uint32_t next_icao;
+	double t;
+	time_t seen;
+	struct tm tm;
+	char date[16], stamp[32];
+
+	duration = argc > 1 ? strtol(argv[1], 0, 10) : 2400;
+	if (argc > 2)
+		Seed += strtoull(argv[2], 0, 10);
+	plane_count = 0;
+	next_icao = 0xA00000;
+	for (t = 0.0; t < duration; )
+	{
+		t -= log(1.0 - Random()) / MESSAGES_PER_SECOND;
+		if ((Random() < 0.003 || plane_count < 5) && plane_count < PLANES_MAX)
+		{
+			plane = &planes[plane_count++];
+			next_icao += RandomInt(1, 50);
+			plane->icao = next_icao;
+			snprintf(plane->callsign, sizeof(plane->callsign), "%s%d", airlines[RandomInt(0, 5)], RandomInt(100, 9999));
+			plane->latitude = 34.15 + Random() * 0.1;
+			plane->longitude = -118.6 + Random() * 0.25;
+			plane->dlatitude = (Random() - 0.5) * 0.001;
+			plane->dlongitude = (Random() - 0.5) * 0.0016;
+			plane->altitude = RandomInt(3000, 12000);
+			plane->speed = RandomInt(180, 320);
+			plane->end = t + 60.0 + Random() * 840.0;
+		}
+		for (i = 0; i < plane_count; )
+			if (planes[i].end < t)
+				planes[i] = planes[--plane_count];
+			else
+				++i;
+		if (plane_count == 0)
+			continue;
+		plane = &planes[RandomInt(0, plane_count - 1)];
+		plane->latitude += plane->dlatitude;
+		plane->longitude += plane->dlongitude;
+		seen = START_TIME + (time_t)t;
+		gmtime_r(&seen, &tm);
+		strftime(date, sizeof(date), "%Y/%m/%d", &tm);
+		strftime(stamp, sizeof(stamp), "%H:%M:%S", &tm);
+		type = types[RandomInt(0, 5)];
+		ms = (int)(fmod(t, 1.0) * 1000);
+		printf("MSG,%d,1,1,%06X,1,%s,%s.%03d,%s,%s.%03d,", type, plane->icao, date, stamp, ms, date, stamp, ms);
+		if (type == 1)
+			printf("%-8s,,,,,,,,,,,0\n", plane->callsign);
+		else if (type == 3)
+			printf(",%d,,,%.5f,%.5f,,,0,0,0,0\n", plane->altitude, plane->latitude, plane->longitude);
+		else if (type == 4)
+			printf(",,%d,100,,,0,,,,,0\n", plane->speed);
+		else
+			printf(",%d,,,,,,,0,,0,0\n", plane->altitude);
+	}
+
+	return 0;
+}
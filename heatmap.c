@@ -0,0 +1,301 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "heatmap.h"
+
+#define PATH_LEN 4096
+#define FINEST_PER_DEGREE ((1 << (2 * (HEAT_LEVELS - 1))) / HEAT_CELL0) // cells of the finest level
+
+// A position maps to a cell of the finest level with one multiply per
+// axis, the cells above it are found by dropping two bits of row and
+// column per level. Every level is updated on each report, so any of them
+// can be saved or drawn straight away.
+
+heatmap_t *
+HeatmapNew(const char *dir, int daily)
+{
+	heatmap_t *map;
+
+	assert((map = calloc(1, sizeof(heatmap_t))) != 0);
+	map->dir = dir;
+	map->daily = daily;
+	map->day_start = map->day_end = -1;
+
+	return map;
+}
+
+static int
+Rows(int level)
+{
+	return HEAT_ROWS0 << (2 * level);
+}
+
+static int
+Cols(int level)
+{
+	return HEAT_COLS0 << (2 * level);
+}
+
+static double
+CellSize(int level)
+{
+	return HEAT_CELL0 / (1 << (2 * level));
+}
+
+int
+HeatmapLevelCell(int level, int row, int col)
+{
+	int i, offset;
+
+	offset = 0;
+	for (i = 0; i < level; ++i)
+		offset += Rows(i) * Cols(i);
+
+	return offset + row * Cols(level) + col;
+}
+
+static void
+Days(heatmap_t *map, uint32_t day, uint32_t last_day)
+{
+	if (day == 0)
+		return;
+	if (map->day == 0 || day < map->day)
+		map->day = day;
+	if (last_day > map->last_day)
+		map->last_day = last_day;
+}
+
+// Local day of seen, worked out once a day rather than per report. The
+// day runs from local midnight to the next, which is 23 or 25 hours
+// apart when daylight saving starts or ends.
+
+static void
+HeatmapDay(heatmap_t *map, time_t seen)
+{
+	uint32_t day;
+	struct tm tm, midnight;
+
+	localtime_r(&seen, &tm);
+	midnight = tm;
+	midnight.tm_hour = midnight.tm_min = midnight.tm_sec = 0;
+	midnight.tm_isdst = -1;
+	map->day_start = mktime(&midnight);
+	midnight = tm;
+	midnight.tm_hour = midnight.tm_min = midnight.tm_sec = 0;
+	midnight.tm_mday += 1;
+	midnight.tm_isdst = -1;
+	map->day_end = mktime(&midnight);
+	day = (tm.tm_year + 1900) * 10000 + (tm.tm_mon + 1) * 100 + tm.tm_mday;
+	if (map->day != 0 && map->day != day && map->daily)
+	{
+		HeatmapSave(map);
+		memset(map->cells, 0, sizeof(map->cells));
+		map->day = map->last_day = 0;
+	}
+	Days(map, day, day);
+}
+
+// new_position is 0 when the plane has not moved since it was last
+// counted, then only the peak can change.
+
+void
+HeatmapAdd(heatmap_t *map, time_t seen, float latitude, float longitude, double naughty, int new_position)
+{
+	int level, row, col;
+	heat_cell_t *cell;
+
+	if (seen < map->day_start || seen >= map->day_end)
+		HeatmapDay(map, seen);
+	row = floor((latitude - HEAT_LAT0) * FINEST_PER_DEGREE);
+	col = floor((longitude - HEAT_LON0) * FINEST_PER_DEGREE);
+	if (row < 0 || row >= Rows(HEAT_LEVELS - 1) || col < 0 || col >= Cols(HEAT_LEVELS - 1))
+		return;
+	for (level = HEAT_LEVELS - 1; level >= 0; --level, row >>= 2, col >>= 2)
+	{
+		cell = &map->cells[HeatmapLevelCell(level, row, col)];
+		if (cell->count == 0 || naughty > cell->peak)
+			cell->peak = naughty;
+		cell->count += new_position != 0;
+	}
+}
+
+static void
+MergeCell(heat_cell_t *cell, const heat_cell_t *from)
+{
+	if (from->count == 0)
+		return;
+	if (cell->count == 0 || from->peak > cell->peak)
+		cell->peak = from->peak;
+	cell->count += from->count;
+}
+
+void
+HeatmapMerge(heatmap_t *map, const heatmap_t *from)
+{
+	int i;
+
+	for (i = 0; i < HEAT_CELLS; ++i)
+		MergeCell(&map->cells[i], &from->cells[i]);
+	Days(map, from->day, from->last_day);
+}
+
+// One polygon feature per cell in use at level, or at every level for -1.
+
+void
+HeatmapGeoJSON(const heatmap_t *map, FILE *fp, int level)
+{
+	int l, row, col, first;
+	double size, lat, lon;
+	const heat_cell_t *cell;
+
+	fprintf(fp, "{\"type\":\"FeatureCollection\",\"features\":[");
+	first = 1;
+	for (l = 0; l < HEAT_LEVELS; ++l)
+	{
+		if (level >= 0 && l != level)
+			continue;
+		size = CellSize(l);
+		for (row = 0; row < Rows(l); ++row)
+			for (col = 0; col < Cols(l); ++col)
+			{
+				cell = &map->cells[HeatmapLevelCell(l, row, col)];
+				if (cell->count == 0)
+					continue;
+				lat = HEAT_LAT0 + row * size;
+				lon = HEAT_LON0 + col * size;
+				fprintf(fp, "%s\n{\"type\":\"Feature\",\"properties\":{\"level\":%d,\"count\":%u,\"peak\":%.1f},"
+					"\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[[[%.4f,%.4f],[%.4f,%.4f],[%.4f,%.4f],[%.4f,%.4f],[%.4f,%.4f]]]}}",
+					first ? "" : ",", l, cell->count, cell->peak,
+					lon, lat, lon + size, lat, lon + size, lat + size, lon, lat + size, lon, lat);
+				first = 0;
+			}
+	}
+	fprintf(fp, "\n]}\n");
+}
+
+// Opens a temporary file beside heat-<days><suffix> in the map's
+// directory, filename is set to the final name.
+
+static FILE *
+SaveOpen(const heatmap_t *map, const char *suffix, char filename[PATH_LEN], char tmp_fn[PATH_LEN + 32])
+{
+	FILE *fp;
+
+	// batch maps always get the range name so they never replace a daily file
+	if (map->daily)
+		snprintf(filename, PATH_LEN, "%s/heat-%08u%s", map->dir, map->day, suffix);
+	else
+		snprintf(filename, PATH_LEN, "%s/heat-%08u-%08u%s", map->dir, map->day, map->last_day, suffix);
+	snprintf(tmp_fn, PATH_LEN + 32, "%s.tmp%ld", filename, (long int)getpid());
+	if ((fp = fopen(tmp_fn, "w")) == 0)
+		fprintf(stderr, "%s: cannot write %s\n", __PRETTY_FUNCTION__, tmp_fn);
+
+	return fp;
+}
+
+static void
+SaveClose(FILE *fp, const char *filename, const char *tmp_fn)
+{
+	int error;
+
+	error = ferror(fp);
+	if (fclose(fp) != 0 || error || rename(tmp_fn, filename) != 0)
+	{
+		fprintf(stderr, "%s: cannot write %s\n", __PRETTY_FUNCTION__, filename);
+		unlink(tmp_fn);
+	}
+}
+
+// Writes the map and a GeoJSON copy of it to its directory, if it has one.
+// map may be 0.
+
+void
+HeatmapSave(const heatmap_t *map)
+{
+	int level, row, col;
+	char filename[PATH_LEN], tmp_fn[PATH_LEN + 32];
+	FILE *fp;
+	heat_header_t header;
+	heat_record_t record;
+	const heat_cell_t *cell;
+
+	if (map == 0 || map->dir == 0 || map->day == 0)
+		return;
+	if ((fp = SaveOpen(map, ".bin", filename, tmp_fn)) == 0)
+		return;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, HEAT_MAGIC, sizeof(header.magic));
+	header.day = map->day;
+	header.last_day = map->last_day;
+	header.levels = HEAT_LEVELS;
+	header.rows0 = HEAT_ROWS0;
+	header.cols0 = HEAT_COLS0;
+	header.lat0 = HEAT_LAT0;
+	header.lon0 = HEAT_LON0;
+	header.cell0 = HEAT_CELL0;
+	for (row = 0; row < HEAT_CELLS; ++row)
+		header.record_count += map->cells[row].count != 0;
+	fwrite(&header, sizeof(header), 1, fp);
+	memset(&record, 0, sizeof(record));
+	for (level = 0; level < HEAT_LEVELS; ++level)
+		for (row = 0; row < Rows(level); ++row)
+			for (col = 0; col < Cols(level); ++col)
+			{
+				cell = &map->cells[HeatmapLevelCell(level, row, col)];
+				if (cell->count == 0)
+					continue;
+				record.level = level;
+				record.row = row;
+				record.col = col;
+				record.cell = *cell;
+				fwrite(&record, sizeof(record), 1, fp);
+			}
+	SaveClose(fp, filename, tmp_fn);
+
+	if ((fp = SaveOpen(map, ".geojson", filename, tmp_fn)) == 0)
+		return;
+	HeatmapGeoJSON(map, fp, -1);
+	SaveClose(fp, filename, tmp_fn);
+}
+
+// Adds the cells in filename to map.
+
+void
+HeatmapLoad(heatmap_t *map, const char *filename)
+{
+	int i;
+	FILE *fp;
+	heat_header_t header;
+	heat_record_t record;
+
+	if ((fp = fopen(filename, "r")) == 0)
+	{
+		fprintf(stderr, "%s: cannot read %s\n", __PRETTY_FUNCTION__, filename);
+		exit(1);
+	}
+	if (fread(&header, sizeof(header), 1, fp) != 1 ||
+	    memcmp(header.magic, HEAT_MAGIC, sizeof(header.magic)) != 0 ||
+	    header.levels != HEAT_LEVELS || header.rows0 != HEAT_ROWS0 || header.cols0 != HEAT_COLS0 ||
+	    header.lat0 != HEAT_LAT0 || header.lon0 != HEAT_LON0 || header.cell0 != HEAT_CELL0)
+	{
+		fprintf(stderr, "%s: %s is not a heatmap for this grid\n", __PRETTY_FUNCTION__, filename);
+		exit(1);
+	}
+	for (i = 0; i < header.record_count; ++i)
+	{
+		if (fread(&record, sizeof(record), 1, fp) != 1 ||
+		    record.level >= HEAT_LEVELS || record.row >= Rows(record.level) || record.col >= Cols(record.level))
+		{
+			fprintf(stderr, "%s: %s is damaged\n", __PRETTY_FUNCTION__, filename);
+			exit(1);
+		}
+		MergeCell(&map->cells[HeatmapLevelCell(record.level, record.row, record.col)], &record.cell);
+	}
+	fclose(fp);
+	Days(map, header.day, header.last_day);
+}
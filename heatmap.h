@@ -0,0 +1,62 @@
+// Where speeding happens: counts of position reports over the limit and
+// the peak naughty percentage, on a grid over the LA basin at HEAT_LEVELS
+// resolutions, each 4 times finer than the one before.
+//
+// A heatmap file (heat-YYYYMMDD.bin for a day of live traffic, or
+// heat-YYYYMMDD-YYYYMMDD.bin from a batch run, even of one day) is a
+// heat_header_t followed by record_count heat_record_t, one per cell in
+// use, host byte order.
+
+#define HEAT_MAGIC "SPDHEAT1"
+#define HEAT_LAT0 33.50
+#define HEAT_LON0 -119.40
+#define HEAT_CELL0 0.08 // degrees at level 0, about 5 miles
+#define HEAT_ROWS0 18
+#define HEAT_COLS0 27
+#define HEAT_LEVELS 3 // down to 0.005 degrees, about 550 yards
+#define HEAT_CELLS (HEAT_ROWS0 * HEAT_COLS0 * (1 + 16 + 256))
+
+typedef struct heat_cell_t {
+	uint32_t count;
+	float peak; // naughty percentage
+} heat_cell_t;
+
+typedef struct heatmap_t {
+	uint32_t day; // yyyymmdd, receiver local time
+	uint32_t last_day; // ...to this one
+	heat_cell_t cells[HEAT_CELLS]; // level 0 first, rows of each level south to north
+	// not saved
+	const char *dir; // where HeatmapSave writes, or 0
+	int daily; // a new day saves the old one and starts over
+	time_t day_start, day_end;
+} heatmap_t;
+
+typedef struct heat_header_t {
+	char magic[8];
+	uint32_t day;
+	uint32_t last_day;
+	uint32_t levels; // HEAT_LEVELS
+	uint32_t rows0; // HEAT_ROWS0
+	uint32_t cols0; // HEAT_COLS0
+	uint32_t record_count;
+	double lat0; // HEAT_LAT0
+	double lon0;
+	double cell0;
+} heat_header_t;
+
+typedef struct heat_record_t {
+	uint8_t level;
+	uint8_t reserved;
+	uint16_t row;
+	uint16_t col;
+	uint16_t reserved2;
+	heat_cell_t cell;
+} heat_record_t;
+
+extern heatmap_t *HeatmapNew(const char *dir, int daily);
+extern void HeatmapAdd(heatmap_t *map, time_t seen, float latitude, float longitude, double naughty, int new_position);
+extern void HeatmapMerge(heatmap_t *map, const heatmap_t *from);
+extern int HeatmapLevelCell(int level, int row, int col);
+extern void HeatmapGeoJSON(const heatmap_t *map, FILE *fp, int level);
+extern void HeatmapSave(const heatmap_t *map);
+extern void HeatmapLoad(heatmap_t *map, const char *filename);
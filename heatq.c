@@ -0,0 +1,108 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <getopt.h>
+#include "heatmap.h"
+
+// merge the heatmap files written by speeders -d, e.g. a month of daily
+// files, into GeoJSON or a list of the busiest cells
+
+typedef struct hot_cell_t {
+	int row;
+	int col;
+	heat_cell_t cell;
+} hot_cell_t;
+
+static int
+CompareHotCells(const void *a, const void *b)
+{
+	const hot_cell_t *ha = a, *hb = b;
+
+	if (ha->cell.count != hb->cell.count)
+		return ha->cell.count > hb->cell.count ? -1 : 1;
+
+	return hb->cell.peak > ha->cell.peak ? 1 : hb->cell.peak < ha->cell.peak ? -1 : 0;
+}
+
+static void
+ShowTop(const heatmap_t *map, int level, int top)
+{
+	int row, col, rows, cols, count, i;
+	double size;
+	hot_cell_t *cells;
+
+	rows = HEAT_ROWS0 << (2 * level);
+	cols = HEAT_COLS0 << (2 * level);
+	size = HEAT_CELL0 / (1 << (2 * level));
+	assert((cells = malloc(rows * cols * sizeof(hot_cell_t))) != 0);
+	count = 0;
+	for (row = 0; row < rows; ++row)
+		for (col = 0; col < cols; ++col)
+			if (map->cells[HeatmapLevelCell(level, row, col)].count)
+			{
+				cells[count].row = row;
+				cells[count].col = col;
+				cells[count].cell = map->cells[HeatmapLevelCell(level, row, col)];
+				++count;
+			}
+	qsort(cells, count, sizeof(hot_cell_t), CompareHotCells);
+	printf("%9s %10s %7s %6s\n", "LAT", "LON", "COUNT", "PEAK");
+	for (i = 0; i < count && i < top; ++i)
+		printf("%9.4f %10.4f %7u %6.1f\n",
+		       HEAT_LAT0 + (cells[i].row + 0.5) * size,
+		       HEAT_LON0 + (cells[i].col + 0.5) * size,
+		       cells[i].cell.count,
+		       cells[i].cell.peak);
+	free(cells);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int opt, usage, i, level, top;
+	heatmap_t *map;
+
+	level = -1;
+	top = 0;
+	usage = 0;
+	while ((opt = getopt(argc, argv, "l:n:")) != EOF)
+		switch (opt)
+		{
+		case 'l' :
+			level = strtol(optarg, 0, 10);
+			if (level < 0 || level >= HEAT_LEVELS)
+				usage = 1;
+			break;
+		case 'n' :
+			top = strtol(optarg, 0, 10);
+			if (top < 1)
+				usage = 1;
+			break;
+		default :
+			usage = 1;
+			break;
+		}
+	if (usage || optind == argc)
+	{
+		fprintf(stderr, "usage: %s [-l level] [-n count] heat.bin ...\n", argv[0]);
+		fprintf(stderr, "\t-l = only this level, 0 (%g degree cells) to %d\n", HEAT_CELL0, HEAT_LEVELS - 1);
+		fprintf(stderr, "\t-n = list this many of the busiest cells instead of writing GeoJSON\n\n");
+		fprintf(stderr, "\texample usage: %s -l 1 /var/lib/speeders/heat-202406*.bin > june.geojson\n", argv[0]);
+
+		return 1;
+	}
+
+	map = HeatmapNew(0, 0);
+	for (i = optind; i < argc; ++i)
+		HeatmapLoad(map, argv[i]);
+	if (top)
+		ShowTop(map, level < 0 ? HEAT_LEVELS - 1 : level, top);
+	else
+		HeatmapGeoJSON(map, stdout, level);
+	free(map);
+
+	return 0;
+}
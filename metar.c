@@ -7,9 +7,10 @@
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <math.h>
 #include <inttypes.h>
 #include <assert.h>
-#include <libxml/xmlreader.h>
+#include <libxml/parser.h>
 #include "metar.h"
 
 static const char *AviationWeatherFormat = "https://aviationweather.gov/cgi-bin/data/dataserver.php?"
@@ -21,34 +22,200 @@ static const char *AviationWeatherFormat = "https://aviationweather.gov/cgi-bin/
 	"format=xml&"
 	"mostRecent=true";
 
-#define XML_BUFFER_SIZE 65536
-static char XML_buffer[XML_BUFFER_SIZE];
-static int XML_buffer_index;
+// METAR XML is parsed as it arrives: each chunk curl delivers goes straight
+// into a libxml2 push parser, and the SAX callbacks below pick the fields
+// we need out of every <METAR> element. Nothing is buffered beyond the
+// text of the current field.
 
-static size_t
-ReceiveXMLData(void *buffer, size_t size, size_t nmemb, void *stream)
+typedef enum metar_field_t {
+	FIELD_NONE,
+	FIELD_STATION_ID,
+	FIELD_OBSERVATION_TIME,
+	FIELD_TEMP_C,
+	FIELD_ELEVATION_M
+} metar_field_t;
+
+struct metar_parser_t {
+	xmlParserCtxtPtr ctxt;
+	void (*observation)(const metar_t *metar, void *context);
+	void *context;
+	int in_metar;
+	metar_field_t field;
+	char text[64];
+	int text_len;
+	metar_t metar;
+	int error;
+};
+
+static void
+ClearMETAR(metar_t *metar)
+{
+	metar->station_id[0] = '\0';
+	metar->observation_time[0] = '\0';
+	metar->temp_c = NAN;
+	metar->elevation_m = NAN;
+}
+
+static void
+StartElement(void *ctx, const xmlChar *name, const xmlChar **attrs)
+{
+	metar_parser_t *parser;
+
+	parser = ctx;
+	if (strcmp((const char *)name, "METAR") == 0)
+	{
+		parser->in_metar = 1;
+		ClearMETAR(&parser->metar);
+		return;
+	}
+	if (! parser->in_metar)
+		return;
+	if (strcmp((const char *)name, "station_id") == 0)
+		parser->field = FIELD_STATION_ID;
+	else if (strcmp((const char *)name, "observation_time") == 0)
+		parser->field = FIELD_OBSERVATION_TIME;
+	else if (strcmp((const char *)name, "temp_c") == 0)
+		parser->field = FIELD_TEMP_C;
+	else if (strcmp((const char *)name, "elevation_m") == 0)
+		parser->field = FIELD_ELEVATION_M;
+	else
+		parser->field = FIELD_NONE;
+	parser->text_len = 0;
+}
+
+static void
+Characters(void *ctx, const xmlChar *ch, int len)
+{
+	metar_parser_t *parser;
+
+	parser = ctx;
+	if (parser->field == FIELD_NONE)
+		return;
+	// text may arrive in pieces when it straddles two chunks
+	if (len > sizeof(parser->text) - 1 - parser->text_len)
+		len = sizeof(parser->text) - 1 - parser->text_len;
+	memcpy(&parser->text[parser->text_len], ch, len);
+	parser->text_len += len;
+}
+
+static void
+EndElement(void *ctx, const xmlChar *name)
+{
+	metar_parser_t *parser;
+	metar_t *metar;
+
+	parser = ctx;
+	metar = &parser->metar;
+	if (! parser->in_metar)
+		return;
+	if (strcmp((const char *)name, "METAR") == 0)
+	{
+		parser->in_metar = 0;
+		if (parser->observation)
+			parser->observation(metar, parser->context);
+		return;
+	}
+	parser->text[parser->text_len] = '\0';
+	switch (parser->field)
+	{
+	case FIELD_STATION_ID :
+		snprintf(metar->station_id, sizeof(metar->station_id), "%.*s", (int)sizeof(metar->station_id) - 1, parser->text);
+		break;
+	case FIELD_OBSERVATION_TIME :
+		snprintf(metar->observation_time, sizeof(metar->observation_time), "%.*s", (int)sizeof(metar->observation_time) - 1, parser->text);
+		break;
+	case FIELD_TEMP_C :
+		metar->temp_c = strtod(parser->text, 0);
+		break;
+	case FIELD_ELEVATION_M :
+		metar->elevation_m = strtod(parser->text, 0);
+		break;
+	case FIELD_NONE :
+		break;
+	}
+	parser->field = FIELD_NONE;
+}
+
+metar_parser_t *
+METARParserNew(void (*observation)(const metar_t *metar, void *context), void *context)
+{
+	metar_parser_t *parser;
+	static xmlSAXHandler sax = {
+		.startElement = StartElement,
+		.endElement = EndElement,
+		.characters = Characters,
+	};
+
+	assert((parser = calloc(1, sizeof(metar_parser_t))) != 0);
+	parser->observation = observation;
+	parser->context = context;
+	parser->field = FIELD_NONE;
+	assert((parser->ctxt = xmlCreatePushParserCtxt(&sax, parser, 0, 0, 0)) != 0);
+	xmlCtxtUseOptions(parser->ctxt, XML_PARSE_NONET | XML_PARSE_NOERROR | XML_PARSE_NOWARNING);
+
+	return parser;
+}
+
+// Returns 0 while the document is well formed so far.
+
+int
+METARParserFeed(metar_parser_t *parser, const char *data, size_t len)
+{
+	if (! parser->error && xmlParseChunk(parser->ctxt, data, len, 0) != 0)
+		parser->error = 1;
+
+	return parser->error;
+}
+
+// Ends the document and frees the parser. Returns 0 if the whole document
+// was well formed.
+
+int
+METARParserFinish(metar_parser_t *parser)
+{
+	int error;
+
+	if (! parser->error && xmlParseChunk(parser->ctxt, 0, 0, 1) != 0)
+		parser->error = 1;
+	error = parser->error || ! parser->ctxt->wellFormed;
+	xmlFreeParserCtxt(parser->ctxt);
+	free(parser);
+
+	return error;
+}
+
+// curl write callback, stream is a metar_parser_t. Stops the transfer
+// once the response can no longer be parsed.
+
+size_t
+METARReceive(void *buffer, size_t size, size_t nmemb, void *stream)
 {
 	size *= nmemb;
-	assert(XML_buffer_index + size < XML_BUFFER_SIZE);
-	strncpy(&XML_buffer[XML_buffer_index], buffer, size);
-	XML_buffer_index += size;
+	if (METARParserFeed(stream, buffer, size))
+		return 0;
 
 	return size;
 }
 
+static void
+LatestObservation(const metar_t *metar, void *context)
+{
+	metar_t *latest;
+
+	latest = context;
+	if (! isnan(metar->temp_c) && ! isnan(metar->elevation_m))
+		*latest = *metar;
+}
+
 static int32_t
 METARFetchNow(const char *station, time_t now, double *temp_c, double *elevation_m)
 {
 	char url[4096];
 	CURL *curlhandle;
 	CURLcode curl_status;
-	FILE *fp;
-	xmlTextReaderPtr reader;
-	int reader_status;
-	int temp_c_next;
-	int elevation_m_next;
-	const xmlChar *name, *value;
-	static const char *metar_fn = "latestmetar.xml";
+	metar_parser_t *parser;
+	metar_t latest;
+	int parse_status;
 	static uint32_t initialized = 0;
 
 	if (! initialized)
@@ -60,65 +227,31 @@ METARFetchNow(const char *station, time_t now, double *temp_c, double *elevation
 		initialized = 1;
 	}
 
-	XML_buffer_index = 0;
 	sprintf(url, AviationWeatherFormat, station, (uint64_t)now);
 
+	ClearMETAR(&latest);
+	parser = METARParserNew(LatestObservation, &latest);
 	curlhandle = curl_easy_init();
 	curl_easy_setopt(curlhandle, CURLOPT_URL, url);
-	curl_easy_setopt(curlhandle, CURLOPT_WRITEFUNCTION, ReceiveXMLData);
-	memset(XML_buffer, 0, XML_BUFFER_SIZE);
+	curl_easy_setopt(curlhandle, CURLOPT_WRITEFUNCTION, METARReceive);
+	curl_easy_setopt(curlhandle, CURLOPT_WRITEDATA, parser);
 	curl_status = curl_easy_perform(curlhandle);
 	curl_easy_cleanup(curlhandle);
+	parse_status = METARParserFinish(parser);
 	if (curl_status)
 	{
 		fprintf(stderr, "%s: curl error %d for %s\n", __PRETTY_FUNCTION__, curl_status, url);
 		return -1;
 	}
-
-	if ((fp = fopen(metar_fn, "w")) == 0)
-	{
-		fprintf(stderr, "%s: error, cannot write METAR XML %s\n", __PRETTY_FUNCTION__, metar_fn);
-		exit(1);
-	}
-	fputs(XML_buffer, fp);
-	fclose(fp);
-
-	reader = xmlReaderForFile(metar_fn, NULL, 0);
-	if (reader == 0)
-	{
-		fprintf(stderr, "%s: unable to read METAR XML file %s\n", __PRETTY_FUNCTION__, metar_fn);
-		exit(1);
-	}
-	temp_c_next = 0;
-	elevation_m_next = 0;
-	while ((reader_status = xmlTextReaderRead(reader)) == 1)
+	if (parse_status != 0 || isnan(latest.temp_c))
 	{
-		name = xmlTextReaderConstName(reader);
-		if (!name)
-			name = BAD_CAST "--";
-		value = xmlTextReaderConstValue(reader);
-		if (xmlTextReaderNodeType(reader) == XML_READER_TYPE_ELEMENT)
-			if (strcmp((const char *)name, "temp_c") == 0)
-				temp_c_next = 1;
-			else if (strcmp((const char *)name, "elevation_m") == 0)
-				elevation_m_next = 1;
-		if (value && xmlTextReaderNodeType(reader) == XML_READER_TYPE_TEXT)
-			if (temp_c_next)
-			{
-				*temp_c = strtod((const char *)value, 0);
-				temp_c_next = 0;
-			}
-			else if (elevation_m_next)
-			{
-				*elevation_m = strtod((const char *)value, 0);
-				elevation_m_next = 0;
-			}
+		fprintf(stderr, "Warning: %s parsing problem in METAR XML for %s\n", __PRETTY_FUNCTION__, station);
+		return -1;
 	}
-	xmlFreeTextReader(reader);
-	if (reader_status != 0)
-		fprintf(stderr, "Warning: %s parsing problem in METAR XML file %s\n", __PRETTY_FUNCTION__, metar_fn);
+	*temp_c = latest.temp_c;
+	*elevation_m = latest.elevation_m;
 
-	return reader_status;
+	return 0;
 }
 
 void
@@ -1 +1,14 @@
+typedef struct metar_t {
+	char station_id[8];
+	char observation_time[32]; // ISO 8601 as sent by the data server
+	double temp_c; // NAN when missing
+	double elevation_m; // NAN when missing
+} metar_t;
+
+typedef struct metar_parser_t metar_parser_t;
+
 extern void METARFetch(const char *station, double *temp_c, double *elevation_m);
+extern metar_parser_t *METARParserNew(void (*observation)(const metar_t *metar, void *context), void *context);
+extern int METARParserFeed(metar_parser_t *parser, const char *data, size_t len);
+extern int METARParserFinish(metar_parser_t *parser);
+extern size_t METARReceive(void *buffer, size_t size, size_t nmemb, void *stream);
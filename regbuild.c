@@ -0,0 +1,173 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "registry.h"
+
+// Build the binary aircraft registry from a CSV dump such as the OpenSky
+// aircraft database. The header row names the columns, icao24,
+// registration, typecode and operator are used, owner stands in for a
+// missing operator. Fields may be quoted with ' or ".
+
+#define MAX_FIELDS 64
+
+static int
+SplitCSV(char *line, char *fields[MAX_FIELDS])
+{
+	int count;
+	char quote;
+	char *src, *dst;
+
+	count = 0;
+	src = line;
+	while (count < MAX_FIELDS)
+	{
+		fields[count++] = dst = src;
+		if (*src == '"' || *src == '\'')
+		{
+			quote = *src++;
+			while (*src && ! (*src == quote && src[1] != quote))
+			{
+				if (*src == quote)
+					++src; // doubled quote
+				*dst++ = *src++;
+			}
+			if (*src == quote)
+				++src;
+		}
+		while (*src && *src != ',' && *src != '\n' && *src != '\r')
+			*dst++ = *src++;
+		if (*src != ',')
+		{
+			*dst = '\0';
+			break;
+		}
+		*dst = '\0';
+		++src;
+	}
+
+	return count;
+}
+
+static int
+FindColumn(char *fields[MAX_FIELDS], int count, const char *name)
+{
+	int i;
+
+	for (i = 0; i < count; ++i)
+		if (strcasecmp(fields[i], name) == 0)
+			return i;
+
+	return -1;
+}
+
+static void
+CopyField(char *dst, size_t size, char *fields[MAX_FIELDS], int count, int column)
+{
+	memset(dst, 0, size);
+	if (column >= 0 && column < count)
+		strncpy(dst, fields[column], size - 1);
+}
+
+static int
+CompareEntries(const void *a, const void *b)
+{
+	const registry_entry_t *ea = a, *eb = b;
+
+	if (ea->icao != eb->icao)
+		return ea->icao < eb->icao ? -1 : 1;
+
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	FILE *fp;
+	int i, count, entry_count, entry_size, unique;
+	int icao_col, registration_col, type_col, operator_col, owner_col;
+	char *end;
+	char line[4096];
+	char tmp_fn[4096];
+	char *fields[MAX_FIELDS];
+	registry_entry_t *entries, *entry;
+	registry_header_t header;
+
+	if (argc != 3)
+	{
+		fprintf(stderr, "usage: %s aircraft.csv registry.bin\n", argv[0]);
+		return 1;
+	}
+	if ((fp = fopen(argv[1], "r")) == 0 || fgets(line, sizeof(line), fp) == 0)
+	{
+		fprintf(stderr, "%s: cannot read %s\n", argv[0], argv[1]);
+		return 1;
+	}
+	count = SplitCSV(line, fields);
+	icao_col = FindColumn(fields, count, "icao24");
+	registration_col = FindColumn(fields, count, "registration");
+	type_col = FindColumn(fields, count, "typecode");
+	operator_col = FindColumn(fields, count, "operator");
+	owner_col = FindColumn(fields, count, "owner");
+	if (icao_col < 0)
+	{
+		fprintf(stderr, "%s: no icao24 column in %s\n", argv[0], argv[1]);
+		return 1;
+	}
+
+	entries = 0;
+	entry_count = 0;
+	entry_size = 0;
+	while (fgets(line, sizeof(line), fp))
+	{
+		count = SplitCSV(line, fields);
+		if (icao_col >= count)
+			continue;
+		if (entry_count == entry_size)
+		{
+			entry_size = entry_size ? entry_size * 2 : 65536;
+			assert((entries = realloc(entries, entry_size * sizeof(registry_entry_t))) != 0);
+		}
+		entry = &entries[entry_count];
+		entry->icao = strtoul(fields[icao_col], &end, 16);
+		if (end == fields[icao_col] || entry->icao > 0xFFFFFF)
+			continue;
+		CopyField(entry->registration, sizeof(entry->registration), fields, count, registration_col);
+		CopyField(entry->type, sizeof(entry->type), fields, count, type_col);
+		CopyField(entry->operator, sizeof(entry->operator), fields, count, operator_col);
+		if (entry->operator[0] == '\0')
+			CopyField(entry->operator, sizeof(entry->operator), fields, count, owner_col);
+		++entry_count;
+	}
+	fclose(fp);
+
+	// stable order is not guaranteed, keep whichever duplicate sorts first
+	qsort(entries, entry_count, sizeof(registry_entry_t), CompareEntries);
+	unique = 0;
+	for (i = 0; i < entry_count; ++i)
+		if (unique == 0 || entries[i].icao != entries[unique - 1].icao)
+			entries[unique++] = entries[i];
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, REGISTRY_MAGIC, sizeof(header.magic));
+	header.count = unique;
+	header.entry_size = sizeof(registry_entry_t);
+	// write beside the target and rename so running instances keep their mapping
+	snprintf(tmp_fn, sizeof(tmp_fn), "%s.tmp%ld", argv[2], (long int)getpid());
+	if ((fp = fopen(tmp_fn, "w")) == 0 ||
+	    fwrite(&header, sizeof(header), 1, fp) != 1 ||
+	    fwrite(entries, sizeof(registry_entry_t), unique, fp) != unique ||
+	    fclose(fp) != 0 ||
+	    rename(tmp_fn, argv[2]) != 0)
+	{
+		fprintf(stderr, "%s: cannot write %s\n", argv[0], argv[2]);
+		unlink(tmp_fn);
+		return 1;
+	}
+	free(entries);
+	printf("%s: %d aircraft\n", argv[2], unique);
+
+	return 0;
+}
@@ -0,0 +1,84 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "registry.h"
+
+// The registry file is mapped read only and shared, nothing is read until
+// a lookup touches its pages. Lookups are a binary search over the sorted
+// records.
+
+static const registry_entry_t *Registry;
+static uint32_t RegistryCount;
+
+void
+RegistryOpen(const char *filename)
+{
+	int fd;
+	struct stat statbuf;
+	void *map;
+	const registry_header_t *header;
+
+	if ((fd = open(filename, O_RDONLY)) < 0 || fstat(fd, &statbuf))
+	{
+		fprintf(stderr, "%s: cannot open aircraft registry %s\n", __PRETTY_FUNCTION__, filename);
+		exit(1);
+	}
+	if (statbuf.st_size < sizeof(registry_header_t) ||
+	    (map = mmap(0, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+	{
+		fprintf(stderr, "%s: cannot map aircraft registry %s\n", __PRETTY_FUNCTION__, filename);
+		exit(1);
+	}
+	close(fd);
+	header = map;
+	if (memcmp(header->magic, REGISTRY_MAGIC, sizeof(header->magic)) != 0 ||
+	    header->entry_size != sizeof(registry_entry_t) ||
+	    sizeof(registry_header_t) + (uint64_t)header->count * sizeof(registry_entry_t) > statbuf.st_size)
+	{
+		fprintf(stderr, "%s: %s is not an aircraft registry, rebuild it with regbuild\n", __PRETTY_FUNCTION__, filename);
+		exit(1);
+	}
+	Registry = (const registry_entry_t *)(header + 1);
+	RegistryCount = header->count;
+}
+
+const registry_entry_t *
+RegistryLookup(uint32_t icao)
+{
+	uint32_t low, high, mid;
+
+	low = 0;
+	high = RegistryCount;
+	while (low < high)
+	{
+		mid = low + (high - low) / 2;
+		if (Registry[mid].icao < icao)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (low < RegistryCount && Registry[low].icao == icao)
+		return &Registry[low];
+
+	return 0;
+}
+
+// Copies a registry field of up to len characters, which need not be nul
+// terminated, to text without quotes, backslashes or control characters,
+// so it can go straight into a JSON or python double quoted string.
+
+void
+RegistryText(const char *field, size_t len, char *text, size_t size)
+{
+	size_t i, j;
+
+	for (i = j = 0; i < len && field[i] && j < size - 1; ++i)
+		if (field[i] != '"' && field[i] != '\\' && (unsigned char)field[i] >= ' ')
+			text[j++] = field[i];
+	text[j] = '\0';
+}
@@ -0,0 +1,21 @@
+// Binary aircraft registry built by regbuild: a registry_header_t followed
+// by count registry_entry_t records sorted by icao, host byte order.
+
+#define REGISTRY_MAGIC "SPDREG01"
+
+typedef struct registry_header_t {
+	char magic[8];
+	uint32_t count;
+	uint32_t entry_size;
+} registry_header_t;
+
+typedef struct registry_entry_t {
+	uint32_t icao;
+	char registration[12];
+	char type[8];
+	char operator[40];
+} registry_entry_t;
+
+extern void RegistryOpen(const char *filename);
+extern const registry_entry_t *RegistryLookup(uint32_t icao);
+extern void RegistryText(const char *field, size_t len, char *text, size_t size);
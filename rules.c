@@ -0,0 +1,492 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "castotas.h"
+#include "tracker.h"
+#include "rules.h"
+
+// Speed limit rules, loaded once and compiled into a flat table of
+// operations. A rules file has one statement per line, # starts a comment:
+//
+//   zone NAME box NW_LAT NW_LON SE_LAT SE_LON
+//   zone NAME circle LAT LON RADIUS nm|mi
+//   rule NAME CONDITION && CONDITION ...
+//
+// Several zone lines with the same name make one zone out of their union.
+// A condition is one of
+//
+//   alt OP FEET          altitude MSL
+//   speed OP KT          groundspeed
+//   speed OP tas KT      groundspeed against KT indicated, as true airspeed
+//                        at the plane's altitude and temperature
+//   speed OP limit[+KT]  the same against the indicated limit of the
+//                        airspace the plane is in, plus or minus KT
+//   limit OP KT          the indicated limit of the airspace itself
+//   zone NAME            plane is inside the zone, ! zone NAME outside
+//   callsign PREFIX
+//
+// with OP one of < <= > >= == !=. Each rule needs a speed condition, the
+// first one is the limit the plane's naughtiness is measured against.
+// Rules are tried in file order and the first that holds is the one that
+// fired, so put the stricter rules first.
+//
+// Everything that depends on the weather or the plane's position, the
+// true airspeed of each distinct tas limit and zone membership, is worked
+// out by RulesPosition when a position arrives. RulesEvaluate is then only
+// integer comparisons.
+
+#define RULES_MAX 64
+#define RULE_OPS_MAX 512
+#define ZONES_MAX 32
+#define ZONE_SHAPES_MAX 128
+#define CALLSIGN_PREFIXES_MAX 64
+#define RULE_NAME_LEN 24
+
+typedef enum rule_opcode_t {
+	OP_ALT,
+	OP_SPEED,
+	OP_SPEED_TAS, // value is a slot in plane->rule_tas
+	OP_LIMIT,
+	OP_ZONE, // value is a zone bit
+	OP_NOT_ZONE,
+	OP_CALLSIGN // value indexes CallsignPrefixes
+} rule_opcode_t;
+
+typedef enum rule_cmp_t {
+	CMP_LT,
+	CMP_LE,
+	CMP_GT,
+	CMP_GE,
+	CMP_EQ,
+	CMP_NE
+} rule_cmp_t;
+
+typedef struct rule_op_t {
+	uint8_t opcode;
+	uint8_t cmp;
+	int32_t value;
+} rule_op_t;
+
+typedef struct rule_t {
+	char name[RULE_NAME_LEN];
+	int first_op;
+	int op_count;
+	int limit_op;
+} rule_t;
+
+typedef struct zone_shape_t {
+	int zone;
+	int circle;
+	double lat0, lon0, lat1, lon1; // box corners, or circle centre in radians
+	double radius; // miles
+} zone_shape_t;
+
+typedef struct tas_limit_t {
+	int32_t cas; // indicated kt, or an offset from the plane's limit_cas
+	int relative;
+} tas_limit_t;
+
+typedef struct callsign_prefix_t {
+	char prefix[CALLSIGN_LEN];
+	int len;
+} callsign_prefix_t;
+
+static rule_t Rules[RULES_MAX];
+static int RuleCount;
+static rule_op_t RuleOps[RULE_OPS_MAX];
+static int RuleOpCount;
+static char ZoneNames[ZONES_MAX][RULE_NAME_LEN];
+static int ZoneCount;
+static zone_shape_t ZoneShapes[ZONE_SHAPES_MAX];
+static int ZoneShapeCount;
+static callsign_prefix_t CallsignPrefixes[CALLSIGN_PREFIXES_MAX];
+static int CallsignPrefixCount;
+static tas_limit_t TASLimits[RULE_TAS_SLOTS]; // one for each plane->rule_tas slot
+static int TASLimitCount;
+
+static const char *RulesSource;
+static int RulesLine;
+
+static void
+RulesError(const char *message, const char *token)
+{
+	fprintf(stderr, "%s:%d: %s%s%s\n", RulesSource, RulesLine, message, token ? " " : "", token ? token : "");
+	exit(1);
+}
+
+static int
+ParseNumber(const char *token, double *value)
+{
+	char *end;
+
+	if (token == 0)
+		return 0;
+	*value = strtod(token, &end);
+
+	return end != token && *end == '\0';
+}
+
+static double
+Number(const char *token)
+{
+	double value;
+
+	if (! ParseNumber(token, &value))
+		RulesError("expected a number, got", token ? token : "end of line");
+
+	return value;
+}
+
+static int
+ParseCmp(const char *token)
+{
+	static const char *cmps[] = { "<", "<=", ">", ">=", "==", "!=" };
+	int i;
+
+	for (i = 0; token && i < sizeof(cmps) / sizeof(cmps[0]); ++i)
+		if (strcmp(token, cmps[i]) == 0)
+			return i;
+	RulesError("expected a comparison, got", token ? token : "end of line");
+
+	return -1;
+}
+
+static int
+FindZone(const char *name, int create)
+{
+	int i;
+
+	if (name == 0)
+		RulesError("zone needs a name", 0);
+	for (i = 0; i < ZoneCount; ++i)
+		if (strcmp(ZoneNames[i], name) == 0)
+			return i;
+	if (! create)
+		RulesError("unknown zone", name);
+	if (ZoneCount == ZONES_MAX)
+		RulesError("too many zones", 0);
+	snprintf(ZoneNames[ZoneCount], RULE_NAME_LEN, "%s", name);
+
+	return ZoneCount++;
+}
+
+static int
+TASSlot(int32_t cas, int relative)
+{
+	int i;
+
+	for (i = 0; i < TASLimitCount; ++i)
+		if (TASLimits[i].cas == cas && TASLimits[i].relative == relative)
+			return i;
+	if (TASLimitCount == RULE_TAS_SLOTS)
+		RulesError("too many different tas limits", 0);
+	TASLimits[TASLimitCount].cas = cas;
+	TASLimits[TASLimitCount].relative = relative;
+
+	return TASLimitCount++;
+}
+
+static void
+CompileZone(char **save)
+{
+	char *name, *shape;
+	zone_shape_t *zone_shape;
+
+	if ((name = strtok_r(0, " \t", save)) == 0 || (shape = strtok_r(0, " \t", save)) == 0)
+		RulesError("zone needs a name and a shape", 0);
+	if (ZoneShapeCount == ZONE_SHAPES_MAX)
+		RulesError("too many zone shapes", 0);
+	zone_shape = &ZoneShapes[ZoneShapeCount];
+	zone_shape->zone = FindZone(name, 1);
+	if (strcmp(shape, "box") == 0)
+	{
+		zone_shape->circle = 0;
+		zone_shape->lat0 = Number(strtok_r(0, " \t", save));
+		zone_shape->lon0 = Number(strtok_r(0, " \t", save));
+		zone_shape->lat1 = Number(strtok_r(0, " \t", save));
+		zone_shape->lon1 = Number(strtok_r(0, " \t", save));
+	}
+	else if (strcmp(shape, "circle") == 0)
+	{
+		zone_shape->circle = 1;
+		zone_shape->lat0 = Number(strtok_r(0, " \t", save)) * M_PI / 180.0;
+		zone_shape->lon0 = Number(strtok_r(0, " \t", save)) * M_PI / 180.0;
+		zone_shape->radius = Number(strtok_r(0, " \t", save));
+		shape = strtok_r(0, " \t", save);
+		if (shape && strcmp(shape, "nm") == 0)
+			zone_shape->radius *= 1.15078;
+		else if (shape == 0 || strcmp(shape, "mi") != 0)
+			RulesError("circle radius needs nm or mi", shape);
+	}
+	else
+		RulesError("unknown zone shape", shape);
+	if (strtok_r(0, " \t", save))
+		RulesError("trailing text after zone", 0);
+	++ZoneShapeCount;
+}
+
+static void
+AddOp(int opcode, int cmp, int32_t value)
+{
+	if (RuleOpCount == RULE_OPS_MAX)
+		RulesError("rules too long", 0);
+	RuleOps[RuleOpCount].opcode = opcode;
+	RuleOps[RuleOpCount].cmp = cmp;
+	RuleOps[RuleOpCount].value = value;
+	++RuleOpCount;
+}
+
+static void
+CompileRule(char **save)
+{
+	int i, cmp;
+	char *name, *token;
+	rule_t *rule;
+
+	if ((name = strtok_r(0, " \t", save)) == 0)
+		RulesError("rule needs a name", 0);
+	if (RuleCount == RULES_MAX)
+		RulesError("too many rules", 0);
+	rule = &Rules[RuleCount];
+	snprintf(rule->name, sizeof(rule->name), "%s", name);
+	rule->first_op = RuleOpCount;
+	rule->limit_op = -1;
+	do
+	{
+		if ((token = strtok_r(0, " \t", save)) == 0)
+			RulesError("rule needs a condition", 0);
+		if (strcmp(token, "alt") == 0)
+		{
+			cmp = ParseCmp(strtok_r(0, " \t", save));
+			AddOp(OP_ALT, cmp, Number(strtok_r(0, " \t", save)));
+		}
+		else if (strcmp(token, "speed") == 0)
+		{
+			cmp = ParseCmp(strtok_r(0, " \t", save));
+			token = strtok_r(0, " \t", save);
+			if (token && strcmp(token, "tas") == 0)
+				AddOp(OP_SPEED_TAS, cmp, TASSlot(Number(strtok_r(0, " \t", save)), 0));
+			else if (token && strncmp(token, "limit", 5) == 0)
+				AddOp(OP_SPEED_TAS, cmp, TASSlot(token[5] ? Number(&token[5]) : 0, 1));
+			else
+				AddOp(OP_SPEED, cmp, Number(token));
+			if (rule->limit_op < 0)
+				rule->limit_op = RuleOpCount - 1;
+		}
+		else if (strcmp(token, "limit") == 0)
+		{
+			cmp = ParseCmp(strtok_r(0, " \t", save));
+			AddOp(OP_LIMIT, cmp, Number(strtok_r(0, " \t", save)));
+		}
+		else if (strcmp(token, "zone") == 0)
+			AddOp(OP_ZONE, CMP_EQ, FindZone(strtok_r(0, " \t", save), 0));
+		else if (strcmp(token, "!") == 0)
+		{
+			if ((token = strtok_r(0, " \t", save)) == 0 || strcmp(token, "zone") != 0)
+				RulesError("! only applies to zone", 0);
+			AddOp(OP_NOT_ZONE, CMP_EQ, FindZone(strtok_r(0, " \t", save), 0));
+		}
+		else if (strcmp(token, "callsign") == 0)
+		{
+			if ((token = strtok_r(0, " \t", save)) == 0)
+				RulesError("callsign needs a prefix", 0);
+			for (i = 0; i < CallsignPrefixCount; ++i)
+				if (strcmp(CallsignPrefixes[i].prefix, token) == 0)
+					break;
+			if (i == CallsignPrefixCount)
+			{
+				if (CallsignPrefixCount == CALLSIGN_PREFIXES_MAX)
+					RulesError("too many callsign prefixes", 0);
+				snprintf(CallsignPrefixes[i].prefix, CALLSIGN_LEN, "%s", token);
+				CallsignPrefixes[i].len = strlen(CallsignPrefixes[i].prefix);
+				++CallsignPrefixCount;
+			}
+			AddOp(OP_CALLSIGN, CMP_EQ, i);
+		}
+		else
+			RulesError("unknown condition", token);
+	} while ((token = strtok_r(0, " \t", save)) != 0 && strcmp(token, "&&") == 0);
+	if (token)
+		RulesError("expected && before", token);
+	if (rule->limit_op < 0)
+		RulesError("rule has no speed limit", rule->name);
+	rule->op_count = RuleOpCount - rule->first_op;
+	++RuleCount;
+}
+
+static void
+CompileLine(char *line)
+{
+	char *token, *save;
+
+	if ((token = strchr(line, '#')) != 0)
+		*token = '\0';
+	line[strcspn(line, "\r\n")] = '\0';
+	if ((token = strtok_r(line, " \t", &save)) == 0)
+		return;
+	if (strcmp(token, "zone") == 0)
+		CompileZone(&save);
+	else if (strcmp(token, "rule") == 0)
+		CompileRule(&save);
+	else
+		RulesError("expected zone or rule, got", token);
+}
+
+// Compile the rules in filename, or default_rules (one statement per
+// line) when filename is 0. Errors are fatal.
+
+void
+RulesLoad(const char *filename, const char *default_rules)
+{
+	FILE *fp;
+	char line[1024];
+	const char *p;
+	size_t len;
+
+	RuleCount = RuleOpCount = ZoneCount = ZoneShapeCount = CallsignPrefixCount = TASLimitCount = 0;
+	RulesLine = 0;
+	if (filename)
+	{
+		if ((fp = fopen(filename, "r")) == 0)
+		{
+			fprintf(stderr, "%s: cannot read rules %s\n", __PRETTY_FUNCTION__, filename);
+			exit(1);
+		}
+		RulesSource = filename;
+		while (fgets(line, sizeof(line), fp))
+		{
+			++RulesLine;
+			CompileLine(line);
+		}
+		fclose(fp);
+	}
+	else
+	{
+		RulesSource = "default rules";
+		for (p = default_rules; *p; p += len + (p[len] == '\n'))
+		{
+			len = strcspn(p, "\n");
+			snprintf(line, sizeof(line), "%.*s", (int)len, p);
+			++RulesLine;
+			CompileLine(line);
+		}
+	}
+	if (RuleCount == 0)
+	{
+		fprintf(stderr, "%s: no rules in %s\n", __PRETTY_FUNCTION__, RulesSource);
+		exit(1);
+	}
+}
+
+static int
+InShape(const zone_shape_t *shape, double latitude, double longitude)
+{
+	double lat, lon, dist;
+
+	if (! shape->circle)
+		return latitude <= shape->lat0 && latitude >= shape->lat1 && longitude >= shape->lon0 && longitude <= shape->lon1;
+	lat = latitude * M_PI / 180.0;
+	lon = longitude * M_PI / 180.0;
+	dist = sin(shape->lat0) * sin(lat) + cos(shape->lat0) * cos(lat) * cos(shape->lon0 - lon);
+	dist = acos(dist) * 180.0 / M_PI * 60.0 * 1.1515; // miles
+
+	return dist <= shape->radius;
+}
+
+void
+RulesPosition(plane_t *plane, double metar_temp_c, double metar_elevation_m)
+{
+	int i;
+
+	for (i = 0; i < TASLimitCount; ++i)
+		plane->rule_tas[i] = CAStoTAS(metar_temp_c, metar_elevation_m,
+					      TASLimits[i].cas + (TASLimits[i].relative ? plane->limit_cas : 0), plane->altitude);
+	plane->zones = 0;
+	for (i = 0; i < ZoneShapeCount; ++i)
+		if (! (plane->zones & (1u << ZoneShapes[i].zone)) && InShape(&ZoneShapes[i], plane->latitude, plane->longitude))
+			plane->zones |= 1u << ZoneShapes[i].zone;
+}
+
+static int
+Compare(int cmp, int32_t a, int32_t b)
+{
+	switch (cmp)
+	{
+	case CMP_LT :
+		return a < b;
+	case CMP_LE :
+		return a <= b;
+	case CMP_GT :
+		return a > b;
+	case CMP_GE :
+		return a >= b;
+	case CMP_EQ :
+		return a == b;
+	default :
+		return a != b;
+	}
+}
+
+static int
+Holds(const rule_op_t *op, const plane_t *plane)
+{
+	switch (op->opcode)
+	{
+	case OP_ALT :
+		return Compare(op->cmp, plane->altitude, op->value);
+	case OP_SPEED :
+		return Compare(op->cmp, plane->speed, op->value);
+	case OP_SPEED_TAS :
+		return Compare(op->cmp, plane->speed, plane->rule_tas[op->value]);
+	case OP_LIMIT :
+		return Compare(op->cmp, plane->limit_cas, op->value);
+	case OP_ZONE :
+		return (plane->zones >> op->value) & 1;
+	case OP_NOT_ZONE :
+		return ! ((plane->zones >> op->value) & 1);
+	default :
+		return strncmp(plane->callsign, CallsignPrefixes[op->value].prefix, CallsignPrefixes[op->value].len) == 0;
+	}
+}
+
+// Index of the first rule the plane breaks, or -1. limit_tas is set to that
+// rule's speed limit.
+
+int
+RulesEvaluate(const plane_t *plane, int32_t *limit_tas)
+{
+	int rule, i;
+	const rule_op_t *op;
+
+	for (rule = 0; rule < RuleCount; ++rule)
+	{
+		op = &RuleOps[Rules[rule].first_op];
+		for (i = 0; i < Rules[rule].op_count && Holds(&op[i], plane); ++i)
+			;
+		if (i == Rules[rule].op_count)
+		{
+			op = &RuleOps[Rules[rule].limit_op];
+			*limit_tas = op->opcode == OP_SPEED_TAS ? plane->rule_tas[op->value] : op->value;
+			return rule;
+		}
+	}
+
+	return -1;
+}
+
+const char *
+RulesName(int rule)
+{
+	return rule >= 0 && rule < RuleCount ? Rules[rule].name : "none";
+}
+
+// Name of the zone with bit zone in plane->zones, 0 past the last one.
+
+const char *
+RulesZoneName(int zone)
+{
+	return zone >= 0 && zone < ZoneCount ? ZoneNames[zone] : 0;
+}
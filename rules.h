@@ -0,0 +1,5 @@
+extern void RulesLoad(const char *filename, const char *default_rules);
+extern void RulesPosition(plane_t *plane, double metar_temp_c, double metar_elevation_m);
+extern int RulesEvaluate(const plane_t *plane, int32_t *limit_tas);
+extern const char *RulesName(int rule);
+extern const char *RulesZoneName(int zone);
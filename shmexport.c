@@ -0,0 +1,98 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tracker.h"
+#include "speedshm.h"
+#include "shmexport.h"
+
+// Writer side of the shared plane table, see speedshm.h. Entry n mirrors
+// slot n of the tracker's plane table.
+
+static speedshm_t *Shm;
+
+static void
+BeginWrite(speedshm_plane_t *entry)
+{
+	__atomic_store_n(&entry->seq, entry->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void
+EndWrite(speedshm_plane_t *entry)
+{
+	__atomic_store_n(&entry->seq, entry->seq + 1, __ATOMIC_RELEASE);
+}
+
+void
+ShmExportStart(const char *name)
+{
+	int fd;
+	void *map;
+
+	if ((fd = shm_open(name, O_CREAT | O_RDWR, 0644)) < 0 ||
+	    ftruncate(fd, sizeof(speedshm_t)) ||
+	    (map = mmap(0, sizeof(speedshm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+	{
+		fprintf(stderr, "%s: cannot map shared memory %s: %s\n", __PRETTY_FUNCTION__, name, strerror(errno));
+		exit(1);
+	}
+	close(fd);
+	Shm = map;
+
+	// readers of a previous run may still have it mapped, the magic goes in last
+	__atomic_store_n(&Shm->magic, 0, __ATOMIC_RELAXED);
+	memset(Shm->planes, 0, sizeof(Shm->planes));
+	Shm->version = SPEEDSHM_VERSION;
+	Shm->entry_size = sizeof(speedshm_plane_t);
+	Shm->entry_count = SPEEDSHM_ENTRIES;
+	Shm->writer_pid = getpid();
+	Shm->updated = time(0);
+	__atomic_store_n(&Shm->magic, SPEEDSHM_MAGIC, __ATOMIC_RELEASE);
+}
+
+void
+ShmExportPlane(int index, const plane_t *plane)
+{
+	speedshm_plane_t *entry;
+
+	if (Shm == 0 || index < 0 || index >= SPEEDSHM_ENTRIES)
+		return;
+	entry = &Shm->planes[index];
+	BeginWrite(entry);
+	entry->valid = 1;
+	entry->icao = plane->icao;
+	entry->speeder = plane->speeder;
+	memcpy(entry->callsign, plane->callsign, sizeof(entry->callsign));
+	entry->callsign[sizeof(entry->callsign) - 1] = '\0';
+	entry->last_seen = plane->last_seen;
+	entry->position_valid = plane->latlong_valid > 0;
+	entry->latitude = plane->latitude;
+	entry->longitude = plane->longitude;
+	entry->altitude = plane->altitude;
+	entry->speed = plane->speed;
+	entry->naughty_speed_tas = plane->naughty_speed_tas;
+	entry->limit_tas = plane->limit_tas;
+	entry->naughty = plane->speeder ? plane->fastest.naughty : 0.0;
+	EndWrite(entry);
+	__atomic_store_n(&Shm->updated, (int64_t)plane->last_seen, __ATOMIC_RELAXED);
+}
+
+void
+ShmExportRemove(int index)
+{
+	speedshm_plane_t *entry;
+
+	if (Shm == 0 || index < 0 || index >= SPEEDSHM_ENTRIES)
+		return;
+	entry = &Shm->planes[index];
+	BeginWrite(entry);
+	entry->valid = 0;
+	EndWrite(entry);
+}
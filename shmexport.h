@@ -0,0 +1,3 @@
+extern void ShmExportStart(const char *name);
+extern void ShmExportPlane(int index, const plane_t *plane);
+extern void ShmExportRemove(int index);
@@ -0,0 +1,332 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "sketch.h"
+
+// A value v lands in bucket ceil(log_gamma(v)) + SKETCH_BUCKETS / 2 and is
+// read back as the middle of that bucket, 2 gamma^k / (gamma + 1), which
+// is within SKETCH_ALPHA of anything in it. Values off either end of the
+// range are kept in the end buckets.
+
+static const double DefaultQuantiles[] = { 0.5, 0.9, 0.99 };
+
+// A daily set starts over each day, saving the day before in dir if it
+// has one.
+
+sketch_set_t *
+SketchNew(const char *dir, int daily)
+{
+	sketch_set_t *set;
+
+	assert((set = calloc(1, sizeof(sketch_set_t))) != 0);
+	strcpy(set->zone_names[SKETCH_MORE], "more");
+	strcpy(set->zone_names[SKETCH_OTHER], "other");
+	set->dir = dir;
+	set->daily = daily;
+	set->hour_start = -1;
+
+	return set;
+}
+
+static void
+Days(sketch_set_t *set, uint32_t day, uint32_t last_day)
+{
+	if (day == 0)
+		return;
+	if (set->day == 0 || day < set->day)
+		set->day = day;
+	if (last_day > set->last_day)
+		set->last_day = last_day;
+}
+
+// Local hour of seen, worked out once an hour rather than per sample.
+
+static void
+SketchHour(sketch_set_t *set, time_t seen)
+{
+	uint32_t day;
+	struct tm tm;
+
+	localtime_r(&seen, &tm);
+	set->hour = tm.tm_hour;
+	set->hour_start = seen - tm.tm_min * 60 - tm.tm_sec;
+	day = (tm.tm_year + 1900) * 10000 + (tm.tm_mon + 1) * 100 + tm.tm_mday;
+	if (set->day != 0 && set->day != day && set->daily)
+	{
+		SketchSave(set);
+		memset(set->sketches, 0, sizeof(set->sketches));
+		set->day = 0;
+	}
+	Days(set, day, day);
+}
+
+static inline void
+Count(sketch_t *sketch, int bucket)
+{
+	++sketch->buckets[bucket];
+	++sketch->count;
+}
+
+void
+SketchAdd(sketch_set_t *set, time_t seen, int32_t altitude, uint32_t zones, int32_t speed, int32_t limit_tas)
+{
+	int band, bucket;
+	sketch_t *sketches;
+
+	if (limit_tas <= 0 || speed <= 0)
+		return;
+	if (seen < set->hour_start || seen >= set->hour_start + 3600)
+		SketchHour(set, seen);
+	band = altitude / 1000;
+	if (band < 0)
+		band = 0;
+	else if (band >= SKETCH_BANDS)
+		band = SKETCH_BANDS - 1;
+	bucket = ceil(log((double)speed / limit_tas) / log(SKETCH_GAMMA)) + SKETCH_BUCKETS / 2;
+	if (bucket < 0)
+		bucket = 0;
+	else if (bucket >= SKETCH_BUCKETS)
+		bucket = SKETCH_BUCKETS - 1;
+
+	sketches = set->sketches[band][set->hour];
+	if (zones == 0)
+		Count(&sketches[SKETCH_OTHER], bucket);
+	else if ((zones & ((1u << SKETCH_MORE) - 1)) == 0)
+		Count(&sketches[SKETCH_MORE], bucket);
+	for (zones &= (1u << SKETCH_MORE) - 1; zones; zones &= zones - 1)
+		Count(&sketches[__builtin_ctz(zones)], bucket);
+}
+
+// Zone of set with this name, taking a free one if need be. Zones that
+// don't fit go to more.
+
+static int
+ZoneIndex(sketch_set_t *set, const char *name)
+{
+	int i;
+
+	if (*name == '\0')
+		return -1;
+	for (i = 0; i < SKETCH_ZONES; ++i)
+		if (strncmp(set->zone_names[i], name, SKETCH_NAME_LEN) == 0)
+			return i;
+	for (i = 0; i < SKETCH_MORE; ++i)
+		if (set->zone_names[i][0] == '\0')
+		{
+			snprintf(set->zone_names[i], SKETCH_NAME_LEN, "%.*s", SKETCH_NAME_LEN - 1, name);
+			return i;
+		}
+
+	return SKETCH_MORE;
+}
+
+static void
+MergeSketch(sketch_t *sketch, const uint32_t *buckets, int first, int count)
+{
+	int i;
+
+	for (i = 0; i < count; ++i)
+	{
+		sketch->buckets[first + i] += buckets[i];
+		sketch->count += buckets[i];
+	}
+}
+
+// Adds from into set, matching zones by name.
+
+void
+SketchMerge(sketch_set_t *set, const sketch_set_t *from)
+{
+	int band, hour, zone, to_zone;
+
+	for (zone = 0; zone < SKETCH_ZONES; ++zone)
+		if ((to_zone = ZoneIndex(set, from->zone_names[zone])) >= 0)
+			for (band = 0; band < SKETCH_BANDS; ++band)
+				for (hour = 0; hour < SKETCH_HOURS; ++hour)
+					if (from->sketches[band][hour][zone].count)
+						MergeSketch(&set->sketches[band][hour][to_zone], from->sketches[band][hour][zone].buckets, 0, SKETCH_BUCKETS);
+	Days(set, from->day, from->last_day);
+}
+
+// Estimated value at quantile q, as a fraction of the limit.
+
+double
+SketchQuantile(const sketch_t *sketch, double q)
+{
+	int i;
+	uint64_t rank, seen;
+
+	if (sketch->count == 0)
+		return 0.0;
+	rank = q * (sketch->count - 1);
+	seen = 0;
+	for (i = 0; i < SKETCH_BUCKETS - 1; ++i)
+		if ((seen += sketch->buckets[i]) > rank)
+			break;
+
+	return 2.0 * pow(SKETCH_GAMMA, i - SKETCH_BUCKETS / 2) / (SKETCH_GAMMA + 1.0);
+}
+
+// One line per band, hour or zone, merging everything else. band, hour and
+// zone limit the sketches used to that one, -1 for all.
+
+void
+SketchPrint(const sketch_set_t *set, sketch_group_t group, int band, int hour, int zone, const double *quantiles, int quantile_count)
+{
+	int b, h, z, key, keys, i;
+	char name[SKETCH_NAME_LEN + 8];
+	sketch_t total;
+
+	keys = group == SKETCH_BY_BAND ? SKETCH_BANDS : group == SKETCH_BY_HOUR ? SKETCH_HOURS : SKETCH_ZONES;
+	for (key = 0; key < keys; ++key)
+	{
+		memset(&total, 0, sizeof(total));
+		for (b = 0; b < SKETCH_BANDS; ++b)
+			for (h = 0; h < SKETCH_HOURS; ++h)
+				for (z = 0; z < SKETCH_ZONES; ++z)
+					if ((band < 0 || b == band) && (hour < 0 || h == hour) && (zone < 0 || z == zone) &&
+					    (group == SKETCH_BY_BAND ? b : group == SKETCH_BY_HOUR ? h : z) == key &&
+					    set->sketches[b][h][z].count)
+						MergeSketch(&total, set->sketches[b][h][z].buckets, 0, SKETCH_BUCKETS);
+		if (total.count == 0)
+			continue;
+		if (group == SKETCH_BY_BAND)
+			sprintf(name, "%d%s", key * 1000, key == SKETCH_BANDS - 1 ? "+" : "");
+		else if (group == SKETCH_BY_HOUR)
+			sprintf(name, "%02d:00", key);
+		else
+			sprintf(name, "%s", set->zone_names[key]);
+		printf("%25s: %u (", name, total.count);
+		for (i = 0; i < quantile_count; ++i)
+			printf("%sp%g %3.0f%%", i ? ", " : "", quantiles[i] * 100.0, SketchQuantile(&total, quantiles[i]) * 100.0);
+		printf(")\n");
+	}
+}
+
+void
+SketchReport(const sketch_set_t *set)
+{
+	if (set->day == 0) // nothing added yet
+		return;
+	if (set->day == set->last_day)
+		printf("speed / limit by altitude band (ft MSL), %u:\n", set->day);
+	else
+		printf("speed / limit by altitude band (ft MSL), %u to %u:\n", set->day, set->last_day);
+	SketchPrint(set, SKETCH_BY_BAND, -1, -1, -1, DefaultQuantiles, sizeof(DefaultQuantiles) / sizeof(DefaultQuantiles[0]));
+}
+
+// Writes set to its directory, if it has one.
+
+void
+SketchSave(const sketch_set_t *set)
+{
+	int band, hour, zone, first, last, error;
+	char filename[4096], tmp_fn[4096 + 32];
+	FILE *fp;
+	sketch_header_t header;
+	sketch_record_t record;
+	const sketch_t *sketch;
+
+	if (set->dir == 0 || set->day == 0)
+		return;
+	// batch sets always get the range name so they never replace a daily file
+	if (set->daily)
+		snprintf(filename, sizeof(filename), "%s/sketch-%08u.bin", set->dir, set->day);
+	else
+		snprintf(filename, sizeof(filename), "%s/sketch-%08u-%08u.bin", set->dir, set->day, set->last_day);
+	snprintf(tmp_fn, sizeof(tmp_fn), "%s.tmp%ld", filename, (long int)getpid());
+	if ((fp = fopen(tmp_fn, "w")) == 0)
+	{
+		fprintf(stderr, "%s: cannot write %s\n", __PRETTY_FUNCTION__, tmp_fn);
+		return;
+	}
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SKETCH_MAGIC, sizeof(header.magic));
+	header.day = set->day;
+	header.last_day = set->last_day;
+	header.buckets = SKETCH_BUCKETS;
+	memcpy(header.zone_names, set->zone_names, sizeof(header.zone_names));
+	for (band = 0; band < SKETCH_BANDS; ++band)
+		for (hour = 0; hour < SKETCH_HOURS; ++hour)
+			for (zone = 0; zone < SKETCH_ZONES; ++zone)
+				header.record_count += set->sketches[band][hour][zone].count != 0;
+	fwrite(&header, sizeof(header), 1, fp);
+
+	// only the buckets between the lowest and highest in use
+	memset(&record, 0, sizeof(record));
+	for (band = 0; band < SKETCH_BANDS; ++band)
+		for (hour = 0; hour < SKETCH_HOURS; ++hour)
+			for (zone = 0; zone < SKETCH_ZONES; ++zone)
+			{
+				sketch = &set->sketches[band][hour][zone];
+				if (sketch->count == 0)
+					continue;
+				for (first = 0; sketch->buckets[first] == 0; ++first)
+					;
+				for (last = SKETCH_BUCKETS - 1; sketch->buckets[last] == 0; --last)
+					;
+				record.band = band;
+				record.hour = hour;
+				record.zone = zone;
+				record.first = first;
+				record.count = last - first + 1;
+				fwrite(&record, sizeof(record), 1, fp);
+				fwrite(&sketch->buckets[first], sizeof(uint32_t), record.count, fp);
+			}
+	error = ferror(fp);
+	if (fclose(fp) != 0 || error || rename(tmp_fn, filename) != 0)
+	{
+		fprintf(stderr, "%s: cannot write %s\n", __PRETTY_FUNCTION__, filename);
+		unlink(tmp_fn);
+	}
+}
+
+// Adds the sketches in filename to set, matching zones by name.
+
+void
+SketchLoad(sketch_set_t *set, const char *filename)
+{
+	int i;
+	int zones[SKETCH_ZONES];
+	uint32_t buckets[SKETCH_BUCKETS];
+	FILE *fp;
+	sketch_header_t header;
+	sketch_record_t record;
+
+	if ((fp = fopen(filename, "r")) == 0)
+	{
+		fprintf(stderr, "%s: cannot read %s\n", __PRETTY_FUNCTION__, filename);
+		exit(1);
+	}
+	if (fread(&header, sizeof(header), 1, fp) != 1 ||
+	    memcmp(header.magic, SKETCH_MAGIC, sizeof(header.magic)) != 0 ||
+	    header.buckets != SKETCH_BUCKETS)
+	{
+		fprintf(stderr, "%s: %s is not a sketch file\n", __PRETTY_FUNCTION__, filename);
+		exit(1);
+	}
+	for (i = 0; i < SKETCH_ZONES; ++i)
+	{
+		header.zone_names[i][SKETCH_NAME_LEN - 1] = '\0';
+		zones[i] = ZoneIndex(set, header.zone_names[i]);
+	}
+	for (i = 0; i < header.record_count; ++i)
+	{
+		if (fread(&record, sizeof(record), 1, fp) != 1 ||
+		    record.band >= SKETCH_BANDS || record.hour >= SKETCH_HOURS || record.zone >= SKETCH_ZONES ||
+		    zones[record.zone] < 0 || record.first + record.count > SKETCH_BUCKETS ||
+		    fread(buckets, sizeof(uint32_t), record.count, fp) != record.count)
+		{
+			fprintf(stderr, "%s: %s is damaged\n", __PRETTY_FUNCTION__, filename);
+			exit(1);
+		}
+		MergeSketch(&set->sketches[record.band][record.hour][zones[record.zone]], buckets, record.first, record.count);
+	}
+	fclose(fp);
+	Days(set, header.day, header.last_day);
+}
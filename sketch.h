@@ -0,0 +1,76 @@
+// Distributions of groundspeed as a fraction of the speed limit (as TAS)
+// for all traffic, one per altitude band, hour of the day and rules zone.
+// Each is a DDSketch style histogram: fixed logarithmic buckets, so any
+// quantile is known to within SKETCH_ALPHA of its value, updates are a
+// counter increment and sketches merge by adding counts.
+//
+// Only the first SKETCH_MORE rules zones get sketches of their own.
+// Traffic that is only in later zones is counted in zone more, so other
+// stays traffic in no zone at all.
+//
+// A sketch file (sketch-YYYYMMDD.bin for a day of live traffic, or
+// sketch-YYYYMMDD-YYYYMMDD.bin from a batch run, even of one day) is a
+// sketch_header_t followed by record_count sketch_record_t, each followed
+// by its count bucket counters, host byte order. Only non-empty sketches
+// are written.
+
+#define SKETCH_MAGIC "SPDSKT02"
+#define SKETCH_ALPHA 0.01 // relative accuracy
+#define SKETCH_GAMMA ((1.0 + SKETCH_ALPHA) / (1.0 - SKETCH_ALPHA))
+#define SKETCH_BUCKETS 256 // SKETCH_GAMMA^-128 to ^128, about 8% to 1280% of the limit
+#define SKETCH_BANDS 11 // 1000 ft bands, the last one catches anything higher
+#define SKETCH_HOURS 24
+#define SKETCH_ZONES 10 // the first 8 rules zones, more and other
+#define SKETCH_MORE (SKETCH_ZONES - 2) // traffic in none of the first 8 rules zones but in a later one
+#define SKETCH_OTHER (SKETCH_ZONES - 1) // traffic in no rules zone at all
+#define SKETCH_NAME_LEN 24
+
+typedef struct sketch_t {
+	uint32_t count;
+	uint32_t buckets[SKETCH_BUCKETS];
+} sketch_t;
+
+typedef struct sketch_set_t {
+	uint32_t day; // yyyymmdd of the samples, receiver local time
+	uint32_t last_day; // ...to this one
+	char zone_names[SKETCH_ZONES][SKETCH_NAME_LEN]; // "" for unused zones
+	sketch_t sketches[SKETCH_BANDS][SKETCH_HOURS][SKETCH_ZONES];
+	// not saved
+	const char *dir; // where SketchSave writes, or 0
+	int daily; // a new day saves the old one and starts over
+	time_t hour_start;
+	int hour;
+} sketch_set_t;
+
+typedef struct sketch_header_t {
+	char magic[8];
+	uint32_t day;
+	uint32_t last_day;
+	uint32_t buckets; // SKETCH_BUCKETS
+	char zone_names[SKETCH_ZONES][SKETCH_NAME_LEN];
+	uint32_t record_count;
+} sketch_header_t;
+
+typedef struct sketch_record_t {
+	uint8_t band;
+	uint8_t hour;
+	uint8_t zone;
+	uint8_t reserved;
+	uint16_t first; // first bucket saved
+	uint16_t count;
+} sketch_record_t;
+
+typedef enum sketch_group_t {
+	SKETCH_BY_BAND,
+	SKETCH_BY_HOUR,
+	SKETCH_BY_ZONE
+} sketch_group_t;
+
+extern sketch_set_t *SketchNew(const char *dir, int daily);
+extern void SketchAdd(sketch_set_t *set, time_t seen, int32_t altitude, uint32_t zones, int32_t speed, int32_t limit_tas);
+extern void SketchMerge(sketch_set_t *set, const sketch_set_t *from);
+extern double SketchQuantile(const sketch_t *sketch, double q);
+extern void SketchPrint(const sketch_set_t *set, sketch_group_t group, int band, int hour, int zone, const double *quantiles, int quantile_count);
+extern void SketchReport(const sketch_set_t *set);
+extern void SketchSave(const sketch_set_t *set);
+extern void SketchLoad(sketch_set_t *set, const char *filename);
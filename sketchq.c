@@ -0,0 +1,115 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include "sketch.h"
+
+// query the speed distribution files written by speeders -d, merging any
+// number of them, e.g. a month of daily files
+
+#define QUANTILES_MAX 16
+
+int
+main(int argc, char *argv[])
+{
+	int opt, usage, i, band, hour, zone, quantile_count;
+	char *p, *end;
+	const char *zone_name;
+	double quantiles[QUANTILES_MAX];
+	sketch_group_t group;
+	sketch_set_t *set;
+
+	group = SKETCH_BY_BAND;
+	band = hour = zone = -1;
+	zone_name = 0;
+	quantiles[0] = 0.5;
+	quantiles[1] = 0.9;
+	quantiles[2] = 0.99;
+	quantile_count = 3;
+	usage = 0;
+	while ((opt = getopt(argc, argv, "a:g:h:q:z:")) != EOF)
+		switch (opt)
+		{
+		case 'a' :
+			band = strtol(optarg, 0, 10) / 1000;
+			if (band < 0)
+				usage = 1;
+			else if (band >= SKETCH_BANDS)
+				band = SKETCH_BANDS - 1;
+			break;
+		case 'g' :
+			if (strcmp(optarg, "band") == 0)
+				group = SKETCH_BY_BAND;
+			else if (strcmp(optarg, "hour") == 0)
+				group = SKETCH_BY_HOUR;
+			else if (strcmp(optarg, "zone") == 0)
+				group = SKETCH_BY_ZONE;
+			else
+				usage = 1;
+			break;
+		case 'h' :
+			hour = strtol(optarg, 0, 10);
+			if (hour < 0 || hour >= SKETCH_HOURS)
+				usage = 1;
+			break;
+		case 'q' :
+			quantile_count = 0;
+			for (p = optarg; *p && quantile_count < QUANTILES_MAX; p = *end ? end + 1 : end)
+			{
+				quantiles[quantile_count] = strtod(p, &end);
+				if (end == p || (*end && *end != ',') || quantiles[quantile_count] < 0.0 || quantiles[quantile_count] > 1.0)
+				{
+					usage = 1;
+					break;
+				}
+				++quantile_count;
+			}
+			if (quantile_count == 0)
+				usage = 1;
+			break;
+		case 'z' :
+			zone_name = optarg;
+			break;
+		default :
+			usage = 1;
+			break;
+		}
+	if (usage || optind == argc)
+	{
+		fprintf(stderr, "usage: %s [-a altitude] [-g band|hour|zone] [-h hour] [-q quantiles] [-z zone] sketch.bin ...\n", argv[0]);
+		fprintf(stderr, "\t-a = only the 1000 ft band with this altitude\n");
+		fprintf(stderr, "\t-g = one line per altitude band (default), hour or zone\n");
+		fprintf(stderr, "\t-h = only this hour of the day, 0 to 23\n");
+		fprintf(stderr, "\t-q = comma separated quantiles, default 0.5,0.9,0.99\n");
+		fprintf(stderr, "\t-z = only this rules zone, more for traffic only in zones past the first %d, other for traffic in none\n\n", SKETCH_MORE);
+		fprintf(stderr, "\texample usage: %s -g hour -z area /var/lib/speeders/sketch-202406*.bin\n", argv[0]);
+
+		return 1;
+	}
+
+	set = SketchNew(0, 0);
+	for (i = optind; i < argc; ++i)
+		SketchLoad(set, argv[i]);
+	if (zone_name)
+	{
+		for (zone = 0; zone < SKETCH_ZONES; ++zone)
+			if (strcmp(set->zone_names[zone], zone_name) == 0)
+				break;
+		if (zone == SKETCH_ZONES)
+		{
+			fprintf(stderr, "%s: no zone %s in these sketches\n", argv[0], zone_name);
+			return 1;
+		}
+	}
+
+	if (set->day == set->last_day)
+		printf("speed / limit, %u:\n", set->day);
+	else
+		printf("speed / limit, %u to %u:\n", set->day, set->last_day);
+	SketchPrint(set, group, band, hour, zone, quantiles, quantile_count);
+	free(set);
+
+	return 0;
+}
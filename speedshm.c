@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "speedshm.h"
+
+// Reader side of the shared plane table, see speedshm.h for the layout.
+
+#define SPEEDSHM_RETRIES 100 // give up on an entry the writer keeps changing
+
+const speedshm_t *
+SpeedShmOpen(const char *name)
+{
+	int fd;
+	struct stat statbuf;
+	const speedshm_t *shm;
+
+	if ((fd = shm_open(name, O_RDONLY, 0)) < 0)
+		return 0;
+	if (fstat(fd, &statbuf) || statbuf.st_size < sizeof(speedshm_t))
+	{
+		close(fd);
+		return 0;
+	}
+	shm = mmap(0, sizeof(speedshm_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED)
+		return 0;
+	if (shm->magic != SPEEDSHM_MAGIC ||
+	    shm->version != SPEEDSHM_VERSION ||
+	    shm->entry_size != sizeof(speedshm_plane_t) ||
+	    shm->entry_count != SPEEDSHM_ENTRIES)
+	{
+		munmap((void *)shm, sizeof(speedshm_t));
+		return 0;
+	}
+
+	return shm;
+}
+
+// Consistent copy of one entry. Returns 1 if it holds a plane, 0 if the
+// slot is empty or could not be read consistently.
+
+int
+SpeedShmRead(const speedshm_t *shm, int index, speedshm_plane_t *plane)
+{
+	int retry;
+	uint32_t seq0, seq1;
+
+	for (retry = 0; retry < SPEEDSHM_RETRIES; ++retry)
+	{
+		seq0 = __atomic_load_n(&shm->planes[index].seq, __ATOMIC_ACQUIRE);
+		if (seq0 & 1)
+			continue;
+		memcpy(plane, (const void *)&shm->planes[index], sizeof(speedshm_plane_t));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq1 = __atomic_load_n(&shm->planes[index].seq, __ATOMIC_RELAXED);
+		if (seq0 == seq1)
+			return plane->valid != 0;
+	}
+
+	return 0;
+}
+
+// Copy every plane in the table, returns the number copied.
+
+int
+SpeedShmSnapshot(const speedshm_t *shm, speedshm_plane_t *planes, int max_planes)
+{
+	int i, count;
+
+	count = 0;
+	for (i = 0; i < SPEEDSHM_ENTRIES && count < max_planes; ++i)
+		if (SpeedShmRead(shm, i, &planes[count]))
+			++count;
+
+	return count;
+}
@@ -0,0 +1,50 @@
+// Live plane table published by speeders -s in POSIX shared memory.
+//
+// The segment is a speedshm_t: a fixed header followed by one entry per
+// slot in the speeders plane table, all fields in host byte order. Each
+// entry is guarded by its own sequence count. The writer makes seq odd,
+// updates the entry, then makes seq even again. A reader copies the entry
+// between two reads of seq and retries if they differ or are odd, so
+// readers never block the writer or each other. SpeedShmRead and
+// SpeedShmSnapshot do this for you.
+//
+// An entry is rewritten after every squitter for its plane, once that
+// squitter has been checked against the rules, so speeder and naughty
+// always include it.
+
+#define SPEEDSHM_NAME "/speeders"
+#define SPEEDSHM_MAGIC 0x31445053 // "SPD1"
+#define SPEEDSHM_VERSION 2
+#define SPEEDSHM_ENTRIES 1024
+#define SPEEDSHM_CALLSIGN_LEN 16
+
+typedef struct speedshm_plane_t {
+	uint32_t seq;
+	uint32_t valid;
+	uint32_t icao;
+	uint32_t speeder; // has broken the speed limit since it came into range
+	char callsign[SPEEDSHM_CALLSIGN_LEN];
+	int64_t last_seen; // receiver time, seconds since the epoch
+	float latitude; // degrees, valid once position_valid is set
+	float longitude;
+	uint32_t position_valid;
+	int32_t altitude; // ft MSL
+	int32_t speed; // groundspeed kt
+	int32_t naughty_speed_tas; // speed limit plus slack as TAS at this altitude, kt
+	int32_t limit_tas; // speed limit (250 kt CAS unless airspace lowers it) as TAS, kt
+	float naughty; // worst percentage over naughty_speed_tas so far
+} speedshm_plane_t;
+
+typedef struct speedshm_t {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entry_size; // sizeof(speedshm_plane_t)
+	uint32_t entry_count;
+	int64_t writer_pid;
+	int64_t updated; // receiver time of the last write
+	speedshm_plane_t planes[SPEEDSHM_ENTRIES];
+} speedshm_t;
+
+extern const speedshm_t *SpeedShmOpen(const char *name);
+extern int SpeedShmRead(const speedshm_t *shm, int index, speedshm_plane_t *plane);
+extern int SpeedShmSnapshot(const speedshm_t *shm, speedshm_plane_t *planes, int max_planes);
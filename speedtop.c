@@ -0,0 +1,122 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "speedshm.h"
+
+// top style view of the planes speeders is tracking, read from the shared
+// plane table published by speeders -s
+
+static int
+ComparePlanes(const void *a, const void *b)
+{
+	const speedshm_plane_t *pa = a, *pb = b;
+
+	if (pa->speeder != pb->speeder)
+		return pa->speeder ? -1 : 1;
+	if (pa->altitude != pb->altitude)
+		return pa->altitude < pb->altitude ? -1 : 1;
+
+	return pa->icao < pb->icao ? -1 : pa->icao > pb->icao;
+}
+
+static void
+Show(const speedshm_t *shm, int clear)
+{
+	int i, count;
+	int64_t updated;
+	time_t now;
+	static speedshm_plane_t planes[SPEEDSHM_ENTRIES];
+
+	count = SpeedShmSnapshot(shm, planes, SPEEDSHM_ENTRIES);
+	qsort(planes, count, sizeof(speedshm_plane_t), ComparePlanes);
+	updated = __atomic_load_n(&shm->updated, __ATOMIC_RELAXED);
+	now = updated;
+
+	if (clear)
+		printf("\033[H\033[2J");
+	printf("speeders pid %ld, %d planes, receiver time %s", (long int)shm->writer_pid, count, ctime(&now));
+	printf("%-6s %-8s %6s %4s %5s %5s %9s %10s %5s %6s\n",
+	       "ICAO", "CALLSIGN", "ALT", "GS", "LIMIT", "LTAS", "LAT", "LON", "AGE", "NV");
+	for (i = 0; i < count; ++i)
+	{
+		printf("%06X %-8.8s ", planes[i].icao, planes[i].callsign);
+		// altitude and the limits derived from it arrive with the position
+		if (planes[i].position_valid)
+			printf("%6d %4d %5d %5d %9.4f %10.4f ",
+			       planes[i].altitude,
+			       planes[i].speed,
+			       planes[i].naughty_speed_tas,
+			       planes[i].limit_tas,
+			       planes[i].latitude,
+			       planes[i].longitude);
+		else
+			printf("%6s %4d %5s %5s %9s %10s ", "", planes[i].speed, "", "", "", "");
+		printf("%5ld ", (long int)(updated - planes[i].last_seen));
+		if (planes[i].speeder)
+			printf("%6.1f", planes[i].naughty);
+		printf("\n");
+	}
+	fflush(stdout);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int opt, once, interval, usage;
+	const char *name;
+	const speedshm_t *shm;
+
+	once = 0;
+	interval = 1;
+	name = SPEEDSHM_NAME;
+	usage = 0;
+	while ((opt = getopt(argc, argv, "1d:n:")) != EOF)
+		switch (opt)
+		{
+		case '1' :
+			once = 1;
+			break;
+		case 'd' :
+			interval = strtol(optarg, 0, 0);
+			if (interval < 1)
+				usage = 1;
+			break;
+		case 'n' :
+			name = optarg;
+			break;
+		default :
+			usage = 1;
+			break;
+		}
+	if (usage)
+	{
+		fprintf(stderr, "usage: %s [-1] [-d seconds] [-n name]\n", argv[0]);
+		fprintf(stderr, "\t-1 = print the table once and exit\n");
+		fprintf(stderr, "\t-d = seconds between refreshes\n");
+		fprintf(stderr, "\t-n = shared memory name, default %s\n", SPEEDSHM_NAME);
+
+		return 1;
+	}
+
+	if ((shm = SpeedShmOpen(name)) == 0)
+	{
+		fprintf(stderr, "%s: no plane table at %s, is speeders running with -s?\n", argv[0], name);
+		return 1;
+	}
+	if (once)
+	{
+		Show(shm, 0);
+		return 0;
+	}
+	for (;;)
+	{
+		Show(shm, 1);
+		sleep(interval);
+	}
+
+	return 0;
+}
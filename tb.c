@@ -5,12 +5,55 @@
 #include "metar.h"
 #include "datetoepoch.h"
 
+static void
+PrintObservation(const metar_t *metar, void *context)
+{
+	printf("%s %s temp %.1f elevation %.1f\n", metar->station_id, metar->observation_time, metar->temp_c, metar->elevation_m);
+}
+
+// Offline check of the METAR parser against saved data server responses,
+// fed in small pieces to exercise values split across chunks.
+
+static int
+ParseFixture(const char *filename)
+{
+	FILE *fp;
+	size_t len;
+	int status;
+	char buffer[7];
+	metar_parser_t *parser;
+
+	if ((fp = fopen(filename, "r")) == 0)
+	{
+		perror(filename);
+		return 1;
+	}
+	printf("%s:\n", filename);
+	parser = METARParserNew(PrintObservation, 0);
+	while ((len = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+		METARParserFeed(parser, buffer, len);
+	fclose(fp);
+	status = METARParserFinish(parser);
+	printf("%s\n", status ? "not well formed" : "ok");
+
+	return status;
+}
+
 int
-main(void)
+main(int argc, char *argv[])
 {
+	int i, status;
 	double temp_c = 15.0, elevation_m = 0.0;
 	static char *station = "KVNY";
 
+	if (argc > 1)
+	{
+		status = 0;
+		for (i = 1; i < argc; ++i)
+			status |= ParseFixture(argv[i]);
+		return status;
+	}
+
 	METARFetch(station, &temp_c, &elevation_m);
 	printf("Temp at %s is %.1f, elevation is %.1f\n", station, temp_c, elevation_m);
 
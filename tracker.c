@@ -0,0 +1,493 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <math.h>
+#include "castotas.h"
+#include "wxcache.h"
+#include "airspace.h"
+#include "datetoepoch.h"
+#include "registry.h"
+#include "tracker.h"
+#include "rules.h"
+#include "sketch.h"
+#include "heatmap.h"
+
+// Upper left and lower right coordinates of area where speeders
+// will be reported
+#define NW_LAT   34.23962554621634
+#define NW_LON -118.64947656671313
+#define SE_LAT   34.13681559402575
+#define SE_LON -118.35026457836128
+
+// ...including anywhere within Y miles of these coords
+// (currently intersection of Roscoe and Reseda Blvds)
+#define ZERO_LAT   34.2207384709914
+#define ZERO_LON -118.5360978679256
+#define ZERO_WITHIN 6.0 // miles
+
+#define FAA_SPEED_LIMIT_CAS 250 // FAA indicated speed limit in kt
+#define FAA_SPEED_ALTITUDE 10000 // ...at or below this MSL altitude in ft
+
+// ADS-B reported speed is groundspeed via GPS unit, https://aerotoolbox.com/airspeed-conversions
+#define NAUGHTY_SLACK_CAS 10 // give them some slack for tail wind, already adjusted for temperature
+#define NAUGHTY_ALTITUDE (FAA_SPEED_ALTITUDE - 1000) // give 'em a break over this altitude
+
+#define CLEAN_AFTER 10 // seconds without a squitter before a plane is considered out of range
+
+static const double ZeroLatRadians = ZERO_LAT * M_PI / 180.0;
+static const double ZeroLonRadians = ZERO_LON * M_PI / 180.0;
+
+static double
+deg2rad(double d)
+{
+	double r;
+
+	r = (d * M_PI) / 180.0;
+
+	return r;
+}
+
+static double
+rad2deg(double rad)
+{
+	return rad * 180.0 / M_PI;
+}
+
+static double
+CalcDistance(double lat1, double lon1, double lat2, double lon2)
+{
+	double theta, dist;
+
+	theta = lon1 - lon2;
+	dist = sin(lat1) * sin(lat2) + cos(lat1) * cos(lat2) * cos(theta);
+	dist = acos(dist);
+	dist = rad2deg(dist);
+	dist = dist * 60.0 * 1.1515;
+
+	return dist;
+}
+static void
+RecordBadPlane(plane_t *plane, int rule, int32_t limit_tas, heatmap_t *heatmap)
+{
+	time_t speed_alt_time_gap;
+	double dist;
+	double lat_radians, lon_radians;
+	double naughty;
+        double squitter_distance;
+
+        // plane location in radians
+	lat_radians = deg2rad(plane->latitude);
+	lon_radians = deg2rad(plane->longitude);
+
+	// do some basic sanity checking
+	speed_alt_time_gap = plane->last_speed - plane->last_location;
+	if (speed_alt_time_gap < 0)
+		speed_alt_time_gap = -speed_alt_time_gap;
+	if (speed_alt_time_gap >= 3)
+		return; // long gap between altitude and speed recording times, might not have been speeding
+	if (plane->altitude < 2000)
+		return; // likely bad altitude in squitter
+	if (plane->speed >= 400)
+		return; // bad speed in squitter
+	dist = CalcDistance(ZeroLatRadians, ZeroLonRadians, lat_radians, lon_radians);
+        squitter_distance = CalcDistance(lat_radians, lon_radians, deg2rad(plane->prev_latitude), deg2rad(plane->prev_longitude));
+        if (squitter_distance >= 4 /* miles */)
+                return; // bad lat or lon in this or previous squitter
+	
+	naughty = ((double)plane->speed - (double)limit_tas) / (double)limit_tas;
+	naughty *= 100.0;
+	if (heatmap)
+	{
+		HeatmapAdd(heatmap, plane->last_seen, plane->latitude, plane->longitude, naughty, plane->heat_position != plane->latlong_valid);
+		plane->heat_position = plane->latlong_valid;
+	}
+	if (plane->speeder == 0 || naughty > plane->fastest.naughty)
+	{
+		if (plane->speeder == 0)
+			plane->registry = RegistryLookup(plane->icao);
+		plane->speeder = 1;
+		plane->fastest.naughty = naughty;
+		plane->fastest.speed = plane->speed;
+		plane->fastest.altitude = plane->altitude;
+		plane->fastest.naughty_speed_tas = limit_tas;
+		plane->fastest.limit_tas = plane->limit_tas;
+		plane->fastest.seen = plane->last_seen;
+		plane->fastest.distance = dist;
+		plane->fastest.latitude = plane->latitude;
+		plane->fastest.longitude = plane->longitude;
+		plane->fastest.prev_latitude = plane->prev_latitude;
+		plane->fastest.prev_longitude = plane->prev_longitude;
+                plane->fastest.squitter_distance = squitter_distance;
+		plane->fastest.rule = rule;
+	}
+}
+
+// Only planes updated since the last pass can have started or got worse.
+// They are passed to update afterwards, so it sees the verdict on the
+// squitter that has just arrived.
+
+static void
+DetectBadPlanes(tracker_t *tracker)
+{
+	int i, rule;
+	int32_t limit_tas;
+	plane_t *planes;
+
+	planes = tracker->planes;
+	for (i = 0; i < tracker->plane_list_count; ++i)
+		if (planes[i].valid && planes[i].dirty)
+		{
+			planes[i].dirty = 0;
+			if (planes[i].shadow)
+				continue;
+			if (planes[i].latlong_valid > 1 &&
+			    (rule = RulesEvaluate(&planes[i], &limit_tas)) >= 0)
+				RecordBadPlane(&planes[i], rule, limit_tas, tracker->heatmap);
+			if (tracker->update)
+				tracker->update(tracker, &planes[i]);
+		}
+}
+
+static plane_t *
+InsertPlane(tracker_t *tracker, uint32_t icao)
+{
+	int i;
+	plane_t *planes;
+
+	planes = tracker->planes;
+	i = 0;
+	while (i < PLANE_COUNT && planes[i].valid)
+		++i;
+	assert(i < PLANE_COUNT); // if this pops something incredibly strange is happening
+	if (i >= tracker->plane_list_count)
+		tracker->plane_list_count = i + 1;
+
+	planes[i].valid = 1;
+	planes[i].speeder = 0;
+	planes[i].shadow = tracker->insert_shadow;
+	planes[i].icao = icao;
+	planes[i].last_seen = 0;
+	planes[i].last_speed = 0;
+	planes[i].last_location = 0;
+	strcpy(planes[i].callsign, "unknown ");
+	planes[i].latlong_valid = 0;
+	planes[i].speed = -1;
+	planes[i].altitude = -100000;
+	planes[i].registry = 0;
+	planes[i].dirty = 0;
+	planes[i].zones = 0;
+	planes[i].limit_cas = FAA_SPEED_LIMIT_CAS;
+	planes[i].heat_position = 0;
+	planes[i].feed_next = 0;
+	planes[i].feed_speeder = 0;
+
+	return &planes[i];
+}
+
+static plane_t *
+FindPlane(tracker_t *tracker, uint32_t icao)
+{
+	int i;
+	plane_t *plane;
+	plane_t *planes;
+
+	planes = tracker->planes;
+	i = 0;
+	while (i < tracker->plane_list_count && ! (planes[i].icao == icao && planes[i].valid))
+		++i;
+	if (i < tracker->plane_list_count)
+		plane = &planes[i];
+	else if (tracker->no_insert)
+		plane = 0;
+	else
+	{
+		plane = InsertPlane(tracker, icao);
+		if (! plane->shadow)
+			++tracker->stats.flight_count;
+	}
+
+	return plane;
+}
+
+static void
+ProcessMSG3(char **pp, plane_t *plane)
+{
+	char *ch;
+	int field;
+	int32_t altitude;
+	float lat, lon;
+	double metar_temp_c, metar_elevation_m;
+
+	field = 0;
+	while ((ch = strsep(pp, ",")) && field < 3)
+		++field;
+	if (ch == 0)
+		return;
+	altitude = strtol(ch, 0, 10);
+	if (altitude < -500 || altitude > 100000)
+		return;
+
+	field = 0;
+	while ((ch = strsep(pp, ",")) && field < 2)
+		++field;
+	if (ch == 0)
+		return;
+
+        lat = 1000.0;
+        sscanf(ch, "%f", &lat);
+        if (lat == 1000.0) // bad squiiter
+                return;
+        ch = strsep(pp, ",");
+        if (ch == 0)
+                return;
+        lon = 1000.0;
+        sscanf(ch, "%f", &lon);
+        if (lon == 1000.0) // bad squitter
+                return;
+	
+	plane->last_location = plane->last_seen;
+	plane->altitude = altitude;
+        if (plane->latlong_valid > 0)
+        {
+                plane->prev_latitude = plane->latitude;
+                plane->prev_longitude = plane->longitude;
+        }
+	plane->latitude = lat;
+	plane->longitude = lon;
+	++plane->latlong_valid;
+	WxLookup(lat, lon, &metar_temp_c, &metar_elevation_m);
+	plane->limit_cas = AirspaceLimit(lat, lon, altitude, FAA_SPEED_LIMIT_CAS);
+	plane->naughty_speed_tas = CAStoTAS(metar_temp_c, metar_elevation_m, plane->limit_cas + NAUGHTY_SLACK_CAS, altitude);
+	plane->limit_tas = CAStoTAS(metar_temp_c, metar_elevation_m, plane->limit_cas, altitude);
+	RulesPosition(plane, metar_temp_c, metar_elevation_m);
+}
+
+static int
+ProcessMSG4(char **pp, plane_t *plane)
+{
+	char *ch;
+	int field;
+	int32_t speed;
+
+	field = 0;
+	while ((ch = strsep(pp, ",")) && field < 4)
+		++field;
+	if (ch == 0)
+		return 0;
+	
+	speed = strtol(ch, 0, 10);
+	if (speed <= 0 || speed > 3000)
+		return 0;
+
+	plane->last_speed = plane->last_seen;
+	plane->speed = speed;
+
+	return 1;
+}
+
+static void
+ProcessMSG1(char **pp, plane_t *plane)
+{
+	char *ch;
+	int field;
+
+	field = 0;
+	while ((ch = strsep(pp, ",")) && field < 2)
+		++field;
+	if (ch == 0 || *ch == '\0')
+		return;
+	strncpy(plane->callsign, ch, sizeof(plane->callsign) - 1);
+}
+
+static time_t
+ProcessPlane(char **pp, tracker_t *tracker, uint32_t message_id, uint32_t icao)
+{
+	plane_t *plane;
+	char *ch, *date_s, *time_s;
+	time_t seen;
+
+	ch = strsep(pp, ",");
+	if (ch == 0 || *ch == '\0')
+		return -1;
+	date_s = strsep(pp, ",");
+	if (date_s == 0 || *date_s == '\0')
+		return -1;
+	time_s = strsep(pp, ",");
+	if (time_s == 0 || *time_s == '\0')
+		return -1;
+	seen = Date2Epoch(date_s, time_s);
+
+	plane = FindPlane(tracker, icao);
+	if (plane == 0)
+		return seen;
+	plane->last_seen = seen;
+	if (plane->shadow)
+		return seen; // only its presence matters
+
+	switch (message_id)
+	{
+	case 1 :
+		ProcessMSG1(pp, plane);
+		break;
+	case 3 :
+		ProcessMSG3(pp, plane);
+		break;
+	case 4 :
+		// the limit comes with the position
+		if (ProcessMSG4(pp, plane) && plane->latlong_valid && tracker->sketches)
+			SketchAdd(tracker->sketches, seen, plane->altitude, plane->zones, plane->speed, plane->limit_tas);
+		break;
+	}
+	plane->dirty = 1;
+
+	return seen;
+}
+
+static void
+CleanPlanes(tracker_t *tracker, time_t now)
+{
+	int i, last_valid_plane;
+	uint32_t plane_count;
+	time_t duration;
+	plane_t *planes;
+
+	planes = tracker->planes;
+	plane_count = 0;
+	last_valid_plane = -1;
+	for (i = 0; i < tracker->plane_list_count; ++i)
+	{
+		if (planes[i].valid)
+		{
+			++plane_count;
+			duration = now - planes[i].last_seen;
+			if (duration > CLEAN_AFTER)
+			{
+				if (planes[i].speeder && ! planes[i].shadow && tracker->retire)
+					tracker->retire(tracker, &planes[i]);
+				if (! planes[i].shadow && tracker->remove)
+					tracker->remove(tracker, &planes[i]);
+				planes[i].valid = 0;
+			}
+			else
+				last_valid_plane = i;
+		}
+	}
+	if (plane_count > tracker->stats.max_plane_count)
+		tracker->stats.max_plane_count = plane_count;
+	tracker->plane_list_count = last_valid_plane + 1;
+}
+
+// Split one BaseStation line into its message type and ICAO address, then
+// hand the remainder to ProcessPlane. Returns the receiver time or -1.
+
+static time_t
+ProcessLine(tracker_t *tracker, char *buffer)
+{
+	uint32_t message_id, icao;
+	char *p;
+	char *ch;
+
+	p = buffer;
+	ch = strsep(&p, ",");
+	if (ch == 0 || strncmp(ch, "MSG", 3) != 0)
+		return -1;
+	++tracker->stats.message_count;
+	ch = strsep(&p, ",");
+	if (ch == 0)
+		return -1;
+	message_id = strtoul(ch, 0, 0);
+	ch = strsep(&p, ",");
+	if (ch == 0)
+		return -1;
+	ch = strsep(&p, ",");
+	if (ch == 0)
+		return -1;
+	ch = strsep(&p, ",");
+	if (ch == 0)
+		return -1;
+	icao = strtoul(ch, 0, 16);
+
+	return ProcessPlane(&p, tracker, message_id, icao);
+}
+
+void
+TrackerLine(tracker_t *tracker, char *buffer)
+{
+	time_t seen;
+
+	seen = ProcessLine(tracker, buffer);
+	if (seen != -1)
+		tracker->receiver_now = seen;
+	CleanPlanes(tracker, tracker->receiver_now);
+	DetectBadPlanes(tracker);
+}
+
+// Receiver time of a line without touching any tracker state, -1 if
+// the line is not a well formed MSG line.
+
+time_t
+TrackerLineTime(const char *buffer)
+{
+	int field;
+	char line[1024];
+	char *p, *ch, *date_s;
+
+	if (strncmp(buffer, "MSG", 3) != 0)
+		return -1;
+	strncpy(line, buffer, sizeof(line) - 1);
+	line[sizeof(line) - 1] = '\0';
+	p = line;
+	for (field = 0; field < 6; ++field)
+		if ((ch = strsep(&p, ",")) == 0)
+			return -1;
+	date_s = strsep(&p, ",");
+	ch = strsep(&p, ",");
+	if (date_s == 0 || *date_s == '\0' || ch == 0 || *ch == '\0')
+		return -1;
+
+	return Date2Epoch(date_s, ch);
+}
+
+// Without a rules file the limit is the one speeders always had: the FAA
+// limit plus some slack, below NAUGHTY_ALTITUDE, in the zone of interest.
+// Where airspace given with -a lowers the limit the rule is named faa200.
+
+void
+TrackerRules(const char *filename)
+{
+	char default_rules[512];
+
+	snprintf(default_rules, sizeof(default_rules),
+		 "zone area box %.17g %.17g %.17g %.17g\n"
+		 "zone area circle %.17g %.17g %.17g mi\n"
+		 "rule faa200 alt <= %d && limit < %d && speed >= limit+%d && zone area\n"
+		 "rule faa250 alt <= %d && speed >= limit+%d && zone area\n",
+		 NW_LAT, NW_LON, SE_LAT, SE_LON,
+		 ZERO_LAT, ZERO_LON, ZERO_WITHIN,
+		 NAUGHTY_ALTITUDE, FAA_SPEED_LIMIT_CAS, NAUGHTY_SLACK_CAS,
+		 NAUGHTY_ALTITUDE, NAUGHTY_SLACK_CAS);
+	RulesLoad(filename, default_rules);
+}
+
+void
+TrackerInit(tracker_t *tracker, void (*retire)(tracker_t *tracker, plane_t *plane), void *context)
+{
+	int i;
+
+	for (i = 0; i < PLANE_COUNT; ++i)
+		tracker->planes[i].valid = 0;
+	tracker->plane_list_count = 0;
+	memset(&tracker->stats, 0, sizeof(tracker->stats));
+	tracker->receiver_now = time(0); // stop optimizer from complaining
+	tracker->insert_shadow = 0;
+	tracker->no_insert = 0;
+	tracker->retire = retire;
+	tracker->update = 0;
+	tracker->remove = 0;
+	tracker->sketches = 0;
+	tracker->heatmap = 0;
+	tracker->context = context;
+}
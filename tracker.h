@@ -0,0 +1,78 @@
+#define PLANE_COUNT 1024 // never more than about 70 planes visible from the casa
+#define CALLSIGN_LEN 16
+#define RULE_TAS_SLOTS 16 // distinct tas limits across all rules
+
+typedef struct fastest_t {
+	uint32_t initialized;
+	double naughty;
+	int32_t naughty_speed_tas;
+	int32_t limit_tas;
+	int32_t speed;
+	int32_t altitude;
+	double distance;
+	float latitude;
+	float longitude;
+	float prev_latitude;
+	float prev_longitude;
+        double squitter_distance;
+	time_t seen;
+	int rule; // the rule that fired
+} fastest_t;
+
+typedef struct plane_t {
+	uint32_t valid;
+	uint32_t speeder;
+	uint32_t shadow; // batch look-back only, owned by another chunk, never detected or reported
+	uint32_t icao;
+	time_t last_seen;
+	time_t last_speed;
+	time_t last_location;
+	char callsign[CALLSIGN_LEN];
+	uint32_t latlong_valid;
+	float latitude;
+	float longitude;
+	float prev_latitude;
+	float prev_longitude;
+	int32_t speed;
+	int32_t altitude;
+	int32_t limit_cas; // indicated limit of the airspace the plane is in
+	int32_t naughty_speed_tas;
+	int32_t limit_tas; // limit_cas as tas
+	uint32_t dirty; // updated since the rules were last evaluated
+	uint32_t zones; // bit per rules zone the plane is in
+	int32_t rule_tas[RULE_TAS_SLOTS]; // rule tas limits at the plane's altitude
+	uint32_t heat_position; // latlong_valid when last counted in the heatmap
+	const struct registry_entry_t *registry; // looked up once the plane becomes a speeder
+	time_t feed_next; // live feed throttle
+	uint32_t feed_speeder; // speeder as last sent on the live feed
+	fastest_t fastest;
+} plane_t;
+
+typedef struct data_stats_t {
+	uint32_t message_count;
+	uint32_t max_plane_count;
+	uint32_t flight_count;
+	time_t next;
+} data_stats_t;
+
+typedef struct tracker_t tracker_t;
+
+struct tracker_t {
+	plane_t planes[PLANE_COUNT];
+	int plane_list_count;
+	data_stats_t stats;
+	time_t receiver_now;
+	uint32_t insert_shadow; // new planes are inserted as shadow planes
+	uint32_t no_insert; // only follow planes already in the table
+	void (*retire)(tracker_t *tracker, plane_t *plane); // called for each speeder as it flies out of range
+	void (*update)(tracker_t *tracker, plane_t *plane); // optional, called after each squitter for a plane once it has been checked for speeding
+	void (*remove)(tracker_t *tracker, plane_t *plane); // optional, called for every plane as it leaves the table
+	struct sketch_set_t *sketches; // optional, speed distribution of every groundspeed report
+	struct heatmap_t *heatmap; // optional, where speeders were over the limit
+	void *context;
+};
+
+extern void TrackerRules(const char *filename);
+extern void TrackerInit(tracker_t *tracker, void (*retire)(tracker_t *tracker, plane_t *plane), void *context);
+extern void TrackerLine(tracker_t *tracker, char *buffer);
+extern time_t TrackerLineTime(const char *buffer);
@@ -0,0 +1,331 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+#include <curl/curl.h>
+#include "metar.h"
+#include "wxcache.h"
+
+// Weather for the whole LA basin. Every station below is fetched at once
+// with the curl multi interface, driven from the main loop by WxCachePoll
+// so a refresh never stalls the tracker. After each refresh temperature
+// and station elevation are interpolated (inverse distance weighted) onto
+// a lat/lon grid, and WxLookup is a single cell read for the aircraft's
+// position.
+
+#define WX_REFRESH (30 * 60) // don't thrash the server, fetch every 30 minutes
+#define WX_TIMEOUT 20 // seconds for one station
+
+// Grid covering the stations, positions outside it use the nearest edge cell
+#define GRID_LAT0 33.50
+#define GRID_LON0 -119.40
+#define GRID_STEP 0.02 // degrees, about a mile
+#define GRID_ROWS 70
+#define GRID_COLS 105
+
+typedef struct wx_reading_t {
+	uint32_t valid;
+	double temp_c;
+	double elevation_m;
+} wx_reading_t;
+
+typedef struct wx_station_t {
+	const char *id;
+	double latitude;
+	double longitude;
+	uint32_t valid;
+	double temp_c;
+	double elevation_m;
+	CURL *handle;
+	metar_parser_t *parser;
+	wx_reading_t *readings; // during a fetch, what this response said about each station
+} wx_station_t;
+
+typedef struct wx_cell_t {
+	float temp_c;
+	float elevation_m;
+} wx_cell_t;
+
+// https://www.aviationweather.gov/docs/metar/stations.txt
+static wx_station_t Stations[] = {
+	{ "KVNY", 34.2098, -118.4898 }, // Van Nuys
+	{ "KBUR", 34.2007, -118.3587 }, // Burbank
+	{ "KWHP", 34.2593, -118.4134 }, // Whiteman
+	{ "KCMA", 34.2137, -119.0943 }, // Camarillo
+	{ "KOXR", 34.2008, -119.2072 }, // Oxnard
+	{ "KSMO", 34.0158, -118.4513 }, // Santa Monica
+	{ "KLAX", 33.9425, -118.4081 }, // Los Angeles Intl
+	{ "KHHR", 33.9228, -118.3352 }, // Hawthorne
+	{ "KTOA", 33.8034, -118.3396 }, // Torrance
+	{ "KLGB", 33.8177, -118.1516 }, // Long Beach
+	{ "KCQT", 34.0236, -118.2911 }, // downtown Los Angeles
+	{ "KEMT", 34.0861, -118.0348 }, // El Monte
+	{ "KFUL", 33.8720, -117.9798 }, // Fullerton
+	{ "KSNA", 33.6757, -117.8682 }, // John Wayne
+	{ "KPOC", 34.0917, -117.7818 }, // Brackett
+	{ "KONT", 34.0560, -117.6012 }, // Ontario
+	{ "KPMD", 34.6294, -118.0846 }, // Palmdale
+	{ "KWJF", 34.7411, -118.2189 }, // Lancaster
+};
+#define STATION_COUNT (sizeof(Stations) / sizeof(Stations[0]))
+
+static const char *DefaultURLFormat = "https://aviationweather.gov/cgi-bin/data/dataserver.php?"
+	"requestType=retrieve&"
+	"dataSource=metars&"
+	"stationString=%s&"
+	"hoursBeforeNow=3&"
+	"format=xml&"
+	"mostRecent=true";
+
+static struct {
+	const char *url_format;
+	CURLM *multi;
+	int fetching;
+	time_t next_fetch;
+	wx_cell_t grids[2][GRID_ROWS][GRID_COLS];
+	wx_cell_t (*grid)[GRID_COLS]; // the one WxLookup reads
+} Wx;
+
+// Responses are matched to stations by station_id, so one response may
+// carry any number of stations. Nothing is used until the whole response
+// has arrived and parsed.
+
+static void
+StationObservation(const metar_t *metar, void *context)
+{
+	int i;
+	wx_station_t *station;
+
+	station = context;
+	if (isnan(metar->temp_c) || isnan(metar->elevation_m))
+		return;
+	for (i = 0; i < STATION_COUNT; ++i)
+		if (strcmp(metar->station_id, Stations[i].id) == 0)
+		{
+			station->readings[i].temp_c = metar->temp_c;
+			station->readings[i].elevation_m = metar->elevation_m;
+			station->readings[i].valid = 1;
+		}
+}
+
+static void
+StartFetch(time_t now)
+{
+	int i;
+	char url[4096];
+
+	for (i = 0; i < STATION_COUNT; ++i)
+	{
+		snprintf(url, sizeof(url), Wx.url_format, Stations[i].id);
+		assert((Stations[i].readings = calloc(STATION_COUNT, sizeof(wx_reading_t))) != 0);
+		Stations[i].parser = METARParserNew(StationObservation, &Stations[i]);
+		Stations[i].handle = curl_easy_init();
+		curl_easy_setopt(Stations[i].handle, CURLOPT_URL, url);
+		curl_easy_setopt(Stations[i].handle, CURLOPT_WRITEFUNCTION, METARReceive);
+		curl_easy_setopt(Stations[i].handle, CURLOPT_WRITEDATA, Stations[i].parser);
+		curl_easy_setopt(Stations[i].handle, CURLOPT_PRIVATE, &Stations[i]);
+		curl_easy_setopt(Stations[i].handle, CURLOPT_TIMEOUT, (long)WX_TIMEOUT);
+		curl_easy_setopt(Stations[i].handle, CURLOPT_NOSIGNAL, 1L);
+		curl_multi_add_handle(Wx.multi, Stations[i].handle);
+	}
+	Wx.fetching = 1;
+	Wx.next_fetch = now + WX_REFRESH;
+}
+
+static void
+StationDone(wx_station_t *station, CURLcode result)
+{
+	int i, parse_status, used;
+	long http_status;
+
+	curl_easy_getinfo(station->handle, CURLINFO_RESPONSE_CODE, &http_status);
+	parse_status = METARParserFinish(station->parser);
+	station->parser = 0;
+	// Deal with occasional empty or bad xml from data server, keep the last good values
+	used = 0;
+	if (result == CURLE_WRITE_ERROR && parse_status != 0)
+		fprintf(stderr, "Warning: %s parsing problem in METAR XML for %s\n", __PRETTY_FUNCTION__, station->id);
+	else if (result != CURLE_OK)
+		fprintf(stderr, "%s: curl error %d for %s\n", __PRETTY_FUNCTION__, result, station->id);
+	else if (http_status != 200)
+		fprintf(stderr, "%s: HTTP status %ld for %s\n", __PRETTY_FUNCTION__, http_status, station->id);
+	else if (parse_status != 0)
+		fprintf(stderr, "Warning: %s parsing problem in METAR XML for %s\n", __PRETTY_FUNCTION__, station->id);
+	else
+	{
+		for (i = 0; i < STATION_COUNT; ++i)
+			if (station->readings[i].valid)
+			{
+				Stations[i].temp_c = station->readings[i].temp_c;
+				Stations[i].elevation_m = station->readings[i].elevation_m;
+				Stations[i].valid = 1;
+				++used;
+			}
+		if (used == 0)
+			fprintf(stderr, "Warning: %s no usable METAR for %s\n", __PRETTY_FUNCTION__, station->id);
+	}
+	free(station->readings);
+	station->readings = 0;
+	curl_multi_remove_handle(Wx.multi, station->handle);
+	curl_easy_cleanup(station->handle);
+	station->handle = 0;
+}
+
+static void
+BuildGrid(void)
+{
+	int i, row, col, valid_count;
+	double lat, lon, dlat, dlon, d2, w, w_sum, temp_sum, elevation_sum, cos_lat;
+	double temp_min, temp_max;
+	wx_cell_t (*grid)[GRID_COLS];
+
+	grid = Wx.grid == Wx.grids[0] ? Wx.grids[1] : Wx.grids[0];
+	valid_count = 0;
+	for (i = 0; i < STATION_COUNT; ++i)
+		valid_count += Stations[i].valid;
+	temp_min = 1000.0;
+	temp_max = -1000.0;
+	for (row = 0; row < GRID_ROWS; ++row)
+	{
+		lat = GRID_LAT0 + (row + 0.5) * GRID_STEP;
+		cos_lat = cos(lat * M_PI / 180.0);
+		for (col = 0; col < GRID_COLS; ++col)
+		{
+			lon = GRID_LON0 + (col + 0.5) * GRID_STEP;
+			if (valid_count == 0)
+			{
+				// standard values until METAR data becomes available
+				// https://www.grc.nasa.gov/www/k-12/airplane/atmosmet.html
+				grid[row][col].temp_c = 15.0;
+				grid[row][col].elevation_m = 0.0;
+				continue;
+			}
+			w_sum = temp_sum = elevation_sum = 0.0;
+			for (i = 0; i < STATION_COUNT; ++i)
+				if (Stations[i].valid)
+				{
+					dlat = lat - Stations[i].latitude;
+					dlon = (lon - Stations[i].longitude) * cos_lat;
+					d2 = dlat * dlat + dlon * dlon;
+					w = 1.0 / (d2 + 1e-6); // inverse square distance, finite at the station
+					w_sum += w;
+					temp_sum += w * Stations[i].temp_c;
+					elevation_sum += w * Stations[i].elevation_m;
+				}
+			grid[row][col].temp_c = temp_sum / w_sum;
+			grid[row][col].elevation_m = elevation_sum / w_sum;
+			if (grid[row][col].temp_c < temp_min)
+				temp_min = grid[row][col].temp_c;
+			if (grid[row][col].temp_c > temp_max)
+				temp_max = grid[row][col].temp_c;
+		}
+	}
+	__atomic_store_n(&Wx.grid, grid, __ATOMIC_RELEASE);
+	if (valid_count)
+		printf("METAR refresh, %d of %d stations, %.1fC to %.1fC.\n", valid_count, (int)STATION_COUNT, temp_min, temp_max);
+}
+
+static void
+Collect(void)
+{
+	int running, left;
+	CURLMsg *message;
+	wx_station_t *station;
+
+	curl_multi_perform(Wx.multi, &running);
+	while ((message = curl_multi_info_read(Wx.multi, &left)) != 0)
+		if (message->msg == CURLMSG_DONE)
+		{
+			curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, (char **)&station);
+			StationDone(station, message->data.result);
+		}
+	if (running == 0)
+	{
+		Wx.fetching = 0;
+		BuildGrid();
+	}
+}
+
+// Non-blocking, call as often as convenient.
+
+void
+WxCachePoll(void)
+{
+	time_t now;
+
+	now = time(0);
+	if (! Wx.fetching)
+	{
+		if (now < Wx.next_fetch)
+			return;
+		StartFetch(now);
+	}
+	Collect();
+}
+
+// Blocking refresh of every station, for batch runs that have no main loop
+// to poll from.
+
+void
+WxCacheRefresh(void)
+{
+	int numfds;
+
+	if (! Wx.fetching)
+		StartFetch(time(0));
+	while (Wx.fetching)
+	{
+		curl_multi_wait(Wx.multi, 0, 0, 1000, &numfds);
+		Collect();
+	}
+}
+
+void
+WxCacheStart(const char *url_format)
+{
+	const char *p;
+
+	// the format is handed to snprintf, allow exactly one %s for the station
+	if (url_format == 0)
+		url_format = DefaultURLFormat;
+	if ((p = strchr(url_format, '%')) == 0 || p[1] != 's' || strchr(p + 2, '%') != 0)
+	{
+		fprintf(stderr, "%s: METAR URL %s needs exactly one %%s for the station\n", __PRETTY_FUNCTION__, url_format);
+		exit(1);
+	}
+	Wx.url_format = url_format;
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+	Wx.multi = curl_multi_init();
+	Wx.next_fetch = 0;
+	Wx.grid = Wx.grids[0];
+	BuildGrid();
+}
+
+void
+WxLookup(float latitude, float longitude, double *temp_c, double *elevation_m)
+{
+	int row, col;
+	wx_cell_t (*grid)[GRID_COLS];
+
+	row = (latitude - GRID_LAT0) / GRID_STEP;
+	col = (longitude - GRID_LON0) / GRID_STEP;
+	if (row < 0)
+		row = 0;
+	else if (row >= GRID_ROWS)
+		row = GRID_ROWS - 1;
+	if (col < 0)
+		col = 0;
+	else if (col >= GRID_COLS)
+		col = GRID_COLS - 1;
+	if ((grid = __atomic_load_n(&Wx.grid, __ATOMIC_ACQUIRE)) == 0)
+	{
+		*temp_c = 15.0;
+		*elevation_m = 0.0;
+		return;
+	}
+	*temp_c = grid[row][col].temp_c;
+	*elevation_m = grid[row][col].elevation_m;
+}
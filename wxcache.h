@@ -0,0 +1,4 @@
+extern void WxCacheStart(const char *url_format);
+extern void WxCachePoll(void);
+extern void WxCacheRefresh(void);
+extern void WxLookup(float latitude, float longitude, double *temp_c, double *elevation_m);